@@ -0,0 +1,49 @@
+// Pieces the loopback benchmarks share: a server that echoes every message
+// back to its sender, and a blocking read of one frame for the plain asio
+// sockets that play the clients
+
+#pragma once
+
+#include <olc_net.hpp>
+
+enum class MsgTypes : uint32_t
+{
+	Echo
+};
+
+using wire = olc::net::wire_header<MsgTypes>;
+
+class EchoServer : public olc::net::server_interface<MsgTypes>
+{
+	public:
+		EchoServer(uint16_t nPort) : olc::net::server_interface<MsgTypes>(nPort)
+		{
+
+		}
+
+	protected:
+		bool OnClientConnect(std::shared_ptr<olc::net::connection<MsgTypes>>) override
+		{
+			return (true);
+		}
+
+		void OnMessage(std::shared_ptr<olc::net::connection<MsgTypes>> client, olc::net::message<MsgTypes> &msg) override
+		{
+			if (client)
+				MessageClient(std::move(client), std::move(msg));
+		}
+};
+
+// Reads one whole frame into vIn, which must hold the largest body expected
+// after the header; false once the socket fails or the frame doesn't parse
+inline bool ReadFrame(boost::asio::ip::tcp::socket &socket, std::vector<uint8_t> &vIn, boost::system::error_code &ec)
+{
+	size_t nMore = 0;
+	olc::net::message_header<MsgTypes> header;
+	return (boost::asio::read(socket, boost::asio::buffer(vIn.data(), wire::nPrefixSize), ec)
+		&& wire::remaining(vIn.data(), nMore)
+		&& (!nMore || boost::asio::read(socket, boost::asio::buffer(vIn.data() + wire::nPrefixSize, nMore), ec))
+		&& wire::decode(vIn.data(), wire::nPrefixSize + nMore, header)
+		&& header.size <= vIn.size()
+		&& boost::asio::read(socket, boost::asio::buffer(vIn.data(), header.size), ec) == header.size);
+}
@@ -0,0 +1,98 @@
+// Loopback echo throughput as the server's io threads go from 1 to 16. Each
+// client connection keeps a window of small messages in flight and sends
+// another as each echo comes back; the server echoes from OnMessage
+//
+//     bench_echo [seconds per step, default 2] [connections, default 32] [window, default 16]
+
+#include "bench_common.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+// One client connection on a blocking socket, run by a thread of its own
+static void Client(uint16_t nPort, size_t nWindow, const std::atomic<bool> &bRunning, std::atomic<uint64_t> &nEchoes)
+{
+	boost::asio::io_context asioContext;
+	boost::asio::ip::tcp::socket socket(asioContext);
+	socket.connect({ boost::asio::ip::make_address("127.0.0.1"), nPort });
+	socket.set_option(boost::asio::ip::tcp::no_delay(true));
+
+	olc::net::message<MsgTypes> msg;
+	msg.header.id = MsgTypes::Echo;
+	for (uint32_t i = 0; i < 8; i++)
+		msg << i;
+
+	std::vector<uint8_t> vFrame(wire::nMaxSize + msg.body.size());
+	size_t nFrame = wire::encode(msg.header, uint32_t(msg.body.size()), vFrame.data());
+	std::memcpy(vFrame.data() + nFrame, msg.body.data(), msg.body.size());
+	nFrame += msg.body.size();
+
+	for (size_t i = 0; i < nWindow; i++)
+		boost::asio::write(socket, boost::asio::buffer(vFrame.data(), nFrame));
+
+	std::vector<uint8_t> vIn(wire::nMaxSize + 1024);
+	uint64_t nLocal = 0;
+	boost::system::error_code ec;
+	while (bRunning.load(std::memory_order_relaxed))
+	{
+		if (!ReadFrame(socket, vIn, ec))
+			break;
+
+		nLocal++;
+		boost::asio::write(socket, boost::asio::buffer(vFrame.data(), nFrame), ec);
+		if (ec)
+			break;
+	}
+	nEchoes.fetch_add(nLocal);
+	socket.close(ec);
+}
+
+int main(int argc, char *argv[])
+{
+	double dSeconds = argc > 1 ? std::atof(argv[1]) : 2.0;
+	size_t nConnections = argc > 2 ? size_t(std::atoi(argv[2])) : 32;
+	size_t nWindow = argc > 3 ? size_t(std::atoi(argv[3])) : 16;
+
+	olc::net::logger::Get().SetLevel(olc::net::log_level::warn);
+	std::printf("%zu connections, %zu in flight each, %.1fs per step, %u hardware threads\n",
+		nConnections, nWindow, dSeconds, std::thread::hardware_concurrency());
+	std::printf("%-11s %14s %10s\n", "io threads", "echoes/s", "scaling");
+
+	double dBase = 0.0;
+	uint16_t nPort = 60500;
+	for (size_t nThreads : { 1, 2, 4, 8, 16 })
+	{
+		EchoServer server(nPort);
+		server.SetIoThreads(nThreads);
+		server.Start();
+
+		std::atomic<bool> bUpdating{ true };
+		std::thread threadUpdate([&]()
+		{
+			while (bUpdating)
+				server.Update(-1, true);
+		});
+
+		std::atomic<bool> bRunning{ true };
+		std::atomic<uint64_t> nEchoes{ 0 };
+		std::vector<std::thread> vClients;
+		for (size_t i = 0; i < nConnections; i++)
+			vClients.emplace_back(Client, nPort, nWindow, std::cref(bRunning), std::ref(nEchoes));
+
+		std::this_thread::sleep_for(std::chrono::duration<double>(dSeconds));
+		bRunning = false;
+		for (auto &t : vClients)
+			t.join();
+
+		bUpdating = false;
+		server.Stop();
+		threadUpdate.join();
+
+		double dRate = double(nEchoes.load()) / dSeconds;
+		if (dBase == 0.0)
+			dBase = dRate;
+		std::printf("%-11zu %14.0f %9.2fx\n", nThreads, dRate, dRate / dBase);
+		nPort++;
+	}
+	return (0);
+}
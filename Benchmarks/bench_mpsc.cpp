@@ -0,0 +1,66 @@
+// Producer contention on the incoming message queue: the lock-free MPSC ring
+// against the deque and mutex of tsqueue. Producers push as fast as they can
+// while a single consumer drains in batches, sleeping when there is nothing
+// to take, as Update(-1, true) does
+//
+//     bench_mpsc [items per run, default 4000000]
+
+#include <net_mpscqueue.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+
+template <typename Queue>
+double Run(size_t nProducers, size_t nItems)
+{
+	Queue q;
+	std::atomic<bool> bGo{ false };
+	std::vector<std::thread> vProducers;
+	size_t nEach = nItems / nProducers;
+
+	for (size_t p = 0; p < nProducers; p++)
+	{
+		vProducers.emplace_back([&q, &bGo, nEach]()
+		{
+			while (!bGo.load(std::memory_order_acquire));
+			for (size_t i = 0; i < nEach; i++)
+				q.push_back(uint64_t(i));
+		});
+	}
+
+	std::vector<uint64_t> vBatch;
+	vBatch.reserve(256);
+	size_t nReceived = 0, nTotal = nEach * nProducers;
+
+	auto tpStart = std::chrono::steady_clock::now();
+	bGo.store(true, std::memory_order_release);
+	while (nReceived < nTotal)
+	{
+		size_t nBatch = q.drain(vBatch, 256);
+		if (nBatch == 0)
+			q.wait();
+		nReceived += nBatch;
+		vBatch.clear();
+	}
+	auto tpEnd = std::chrono::steady_clock::now();
+
+	for (auto &t : vProducers)
+		t.join();
+	return (std::chrono::duration<double>(tpEnd - tpStart).count());
+}
+
+int main(int argc, char *argv[])
+{
+	size_t nItems = argc > 1 ? size_t(std::strtoull(argv[1], nullptr, 10)) : 4000000;
+
+	std::printf("%-10s %16s %16s %10s\n", "producers", "tsqueue Mops/s", "mpsc Mops/s", "speedup");
+	for (size_t nProducers : { 1, 2, 4, 8, 16 })
+	{
+		double dMutex = Run<ocl::net::tsqueue<uint64_t>>(nProducers, nItems);
+		double dRing = Run<ocl::net::mpsc_queue<uint64_t>>(nProducers, nItems);
+		double nDone = double(nItems / nProducers * nProducers);
+		std::printf("%-10zu %16.2f %16.2f %9.2fx\n", nProducers,
+			nDone / dMutex / 1e6, nDone / dRing / 1e6, dMutex / dRing);
+	}
+	return (0);
+}
@@ -0,0 +1,117 @@
+// Loopback round trip latency under each socket option. A client sends a
+// small message and waits for the server to echo it before sending the next.
+// It writes the header and body separately, as many clients do, which is
+// the pattern where Nagle and delayed acks add up. Client and server sockets
+// both take the options
+//
+//     bench_sockopt [round trips per option, default 2000]
+
+#include "bench_common.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+
+// Round trip times in microseconds, in the order they were taken
+static std::vector<double> Measure(uint16_t nPort, const olc::net::socket_options &options, size_t nRoundTrips)
+{
+	boost::asio::io_context asioContext;
+	boost::asio::ip::tcp::socket socket(asioContext);
+	socket.connect({ boost::asio::ip::make_address("127.0.0.1"), nPort });
+	olc::net::apply_socket_options(socket, options);
+
+	olc::net::message<MsgTypes> msg;
+	msg.header.id = MsgTypes::Echo;
+	for (uint32_t i = 0; i < 8; i++)
+		msg << i;
+
+	uint8_t vHeader[wire::nMaxSize];
+	size_t nHeader = wire::encode(msg.header, uint32_t(msg.body.size()), vHeader);
+
+	std::vector<uint8_t> vIn(wire::nMaxSize + 1024);
+	std::vector<double> vMicros;
+	vMicros.reserve(nRoundTrips);
+	boost::system::error_code ec;
+	for (size_t i = 0; i < nRoundTrips; i++)
+	{
+		auto tpStart = std::chrono::steady_clock::now();
+		boost::asio::write(socket, boost::asio::buffer(vHeader, nHeader), ec);
+		boost::asio::write(socket, boost::asio::buffer(msg.body.data(), msg.body.size()), ec);
+
+		if (ec || !ReadFrame(socket, vIn, ec))
+			break;
+		vMicros.push_back(std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - tpStart).count());
+
+		// Linux drops out of quick ack mode by itself, as the connections know
+		if (options.bQuickAck)
+			olc::net::apply_socket_options(socket, options);
+	}
+	socket.close(ec);
+	return (vMicros);
+}
+
+static double Percentile(const std::vector<double> &vSorted, double dFraction)
+{
+	if (vSorted.empty())
+		return (0.0);
+	return (vSorted[std::min(vSorted.size() - 1, size_t(dFraction * double(vSorted.size())))]);
+}
+
+int main(int argc, char *argv[])
+{
+	size_t nRoundTrips = argc > 1 ? size_t(std::atoi(argv[1])) : 2000;
+
+	struct option_set
+	{
+		const char *sName;
+		olc::net::socket_options options;
+	};
+
+	std::vector<option_set> vSets(7);
+	vSets[0].sName = "default";
+	vSets[1].sName = "no_delay";
+	vSets[1].options.bNoDelay = true;
+	vSets[2].sName = "quick_ack";
+	vSets[2].options.bQuickAck = true;
+	vSets[3].sName = "no_delay+quick_ack";
+	vSets[3].options.bNoDelay = true;
+	vSets[3].options.bQuickAck = true;
+	vSets[4].sName = "buffers 16K";
+	vSets[4].options.nSendBuffer = 16 * 1024;
+	vSets[4].options.nReceiveBuffer = 16 * 1024;
+	vSets[5].sName = "notsent_lowat 16K";
+	vSets[5].options.nNotSentLowat = 16 * 1024;
+	vSets[6].sName = "busy_poll 50us";
+	vSets[6].options.nBusyPollMicros = 50;
+
+	olc::net::logger::Get().SetLevel(olc::net::log_level::warn);
+	std::printf("%zu round trips per option, microseconds\n", nRoundTrips);
+	std::printf("%-20s %10s %10s %10s %10s %10s\n", "options", "p50", "p90", "p99", "p99.9", "max");
+
+	uint16_t nPort = 60600;
+	for (const auto &set : vSets)
+	{
+		EchoServer server(nPort);
+		server.SetSocketOptions(set.options);
+		server.Start();
+
+		std::atomic<bool> bUpdating{ true };
+		std::thread threadUpdate([&]()
+		{
+			while (bUpdating)
+				server.Update(-1, true);
+		});
+
+		std::vector<double> vMicros = Measure(nPort, set.options, nRoundTrips);
+
+		bUpdating = false;
+		server.Stop();
+		threadUpdate.join();
+
+		std::sort(vMicros.begin(), vMicros.end());
+		std::printf("%-20s %10.1f %10.1f %10.1f %10.1f %10.1f\n", set.sName,
+			Percentile(vMicros, 0.5), Percentile(vMicros, 0.9), Percentile(vMicros, 0.99),
+			Percentile(vMicros, 0.999), vMicros.empty() ? 0.0 : vMicros.back());
+		nPort++;
+	}
+	return (0);
+}
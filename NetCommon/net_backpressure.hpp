@@ -0,0 +1,132 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_message.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// Watermarks for a server's incoming queue. Once the queue holds more than
+		// a high mark, connections stop reading from their sockets; they start
+		// again once it has drained below the low marks. A high mark of zero
+		// means that dimension is not limited
+		struct backpressure_config
+		{
+			size_t nHighItems = 0;
+			size_t nLowItems = 0;
+			size_t nHighBytes = 0;
+			size_t nLowBytes = 0;
+		};
+
+		// Snapshot of the incoming queue as seen by backpressure
+		struct backpressure_stats
+		{
+			size_t nItems = 0;
+			size_t nBytes = 0;
+			size_t nPausedConnections = 0;
+			uint64_t nPauses = 0;
+			uint64_t nResumes = 0;
+		};
+
+		// Tracks the depth of an incoming queue and parks connections whose reads
+		// would overfill it. Producers (io threads) call OnEnqueue/Pause, the
+		// consumer (Update) calls OnDequeue
+		template <typename T>
+		class backpressure
+		{
+			public:
+				void Configure(const backpressure_config &config)
+				{
+					m_config = config;
+				}
+
+				// Accounts for a message about to be queued, returns true if the
+				// queue is now above a high watermark
+				bool OnEnqueue(size_t nBytes)
+				{
+					size_t nItems = m_nItems.fetch_add(1) + 1;
+					nBytes = m_nBytes.fetch_add(nBytes) + nBytes;
+					return ((m_config.nHighItems && nItems > m_config.nHighItems)
+						|| (m_config.nHighBytes && nBytes > m_config.nHighBytes));
+				}
+
+				// Accounts for messages taken off the queue, and resumes any parked
+				// connections once it is below the low watermarks
+				void OnDequeue(size_t nItems, size_t nBytes)
+				{
+					m_nItems.fetch_sub(nItems);
+					m_nBytes.fetch_sub(nBytes);
+
+					if (m_bAnyPaused.load() && BelowLowWatermark())
+					{
+						std::vector<std::shared_ptr<connection<T>>> vResume;
+						{
+							std::scoped_lock lock(m_muxPaused);
+							if (!BelowLowWatermark())
+								return;
+							vResume.swap(m_vPaused);
+							m_bAnyPaused.store(false);
+						}
+
+						m_nResumes += vResume.size();
+						for (auto &conn : vResume)
+							conn->ResumeReading();
+					}
+				}
+
+				// Parks a connection until the queue drains. Returns false if the
+				// queue already drained in the meantime, in which case the caller
+				// should simply carry on reading
+				bool Pause(std::shared_ptr<connection<T>> conn)
+				{
+					std::scoped_lock lock(m_muxPaused);
+					m_bAnyPaused.store(true);
+
+					// The consumer may have drained the queue since OnEnqueue
+					// and found nobody to resume
+					if (BelowLowWatermark())
+					{
+						m_bAnyPaused.store(!m_vPaused.empty());
+						return (false);
+					}
+
+					m_vPaused.push_back(std::move(conn));
+					m_nPauses++;
+					return (true);
+				}
+
+				backpressure_stats GetStats()
+				{
+					backpressure_stats stats;
+					stats.nItems = m_nItems.load(std::memory_order_relaxed);
+					stats.nBytes = m_nBytes.load(std::memory_order_relaxed);
+					stats.nPauses = m_nPauses.load(std::memory_order_relaxed);
+					stats.nResumes = m_nResumes.load(std::memory_order_relaxed);
+
+					std::scoped_lock lock(m_muxPaused);
+					stats.nPausedConnections = m_vPaused.size();
+					return (stats);
+				}
+
+			private:
+				bool BelowLowWatermark() const
+				{
+					return ((!m_config.nHighItems || m_nItems.load() <= m_config.nLowItems)
+						&& (!m_config.nHighBytes || m_nBytes.load() <= m_config.nLowBytes));
+				}
+
+			private:
+				backpressure_config m_config;
+
+				std::atomic<size_t>		m_nItems{ 0 };
+				std::atomic<size_t>		m_nBytes{ 0 };
+				std::atomic<uint64_t>	m_nPauses{ 0 };
+				std::atomic<uint64_t>	m_nResumes{ 0 };
+
+				// Connections waiting for the queue to drain
+				std::mutex									m_muxPaused;
+				std::vector<std::shared_ptr<connection<T>>>	m_vPaused;
+				std::atomic<bool>							m_bAnyPaused{ false };
+		};
+	}
+}
@@ -0,0 +1,137 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_pool.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// Byte buffer for message bodies. Up to InlineSize bytes live inside the
+		// object itself, so small messages never touch the heap; anything larger
+		// spills to a block from buffer_pool. It offers the parts of std::vector<uint8_t>
+		// the messages use. Note resize does not zero newly exposed bytes - they
+		// are always about to be overwritten by a memcpy or a socket read
+		template <size_t InlineSize = 64>
+		class message_body
+		{
+			public:
+				message_body() = default;
+
+				message_body(const message_body &other)
+				{
+					resize(other.m_nSize);
+					std::memcpy(m_pData, other.m_pData, m_nSize);
+				}
+
+				message_body(message_body &&other) noexcept
+				{
+					steal(other);
+				}
+
+				message_body &operator=(const message_body &other)
+				{
+					if (this != &other)
+					{
+						m_nSize = 0;
+						resize(other.m_nSize);
+						std::memcpy(m_pData, other.m_pData, m_nSize);
+					}
+					return (*this);
+				}
+
+				message_body &operator=(message_body &&other) noexcept
+				{
+					if (this != &other)
+					{
+						release();
+						steal(other);
+					}
+					return (*this);
+				}
+
+				~message_body()
+				{
+					release();
+				}
+
+			public:
+				uint8_t *data() { return (m_pData); }
+				const uint8_t *data() const { return (m_pData); }
+
+				size_t size() const { return (m_nSize); }
+				size_t capacity() const { return (m_nCapacity); }
+				bool empty() const { return (m_nSize == 0); }
+
+				uint8_t *begin() { return (m_pData); }
+				uint8_t *end() { return (m_pData + m_nSize); }
+				const uint8_t *begin() const { return (m_pData); }
+				const uint8_t *end() const { return (m_pData + m_nSize); }
+
+				uint8_t &operator[](size_t i) { return (m_pData[i]); }
+				const uint8_t &operator[](size_t i) const { return (m_pData[i]); }
+
+				void clear() { m_nSize = 0; }
+
+				// Makes room for at least nCapacity bytes, keeping the contents.
+				// Heap blocks come from, and go back to, the buffer pool
+				void reserve(size_t nCapacity)
+				{
+					if (nCapacity <= m_nCapacity)
+						return;
+
+					nCapacity = buffer_pool::RoundUp(nCapacity);
+					uint8_t *pNew = static_cast<uint8_t*>(buffer_pool::Allocate(nCapacity));
+					std::memcpy(pNew, m_pData, m_nSize);
+					release();
+					m_pData = pNew;
+					m_nCapacity = nCapacity;
+				}
+
+				void resize(size_t nSize)
+				{
+					// Grow geometrically so repeated appends stay amortised O(1)
+					if (nSize > m_nCapacity)
+						reserve(std::max(nSize, m_nCapacity * 2));
+					m_nSize = nSize;
+				}
+
+				// True while the contents still fit in the inline storage
+				bool is_inline() const { return (m_pData == m_vInline); }
+
+			private:
+				void release()
+				{
+					if (!is_inline())
+						buffer_pool::Release(m_pData, m_nCapacity);
+					m_pData = m_vInline;
+					m_nCapacity = InlineSize;
+				}
+
+				// Takes other's contents, leaving it empty. Heap blocks change hands,
+				// inline contents are copied as there is nothing to hand over
+				void steal(message_body &other)
+				{
+					if (other.is_inline())
+					{
+						std::memcpy(m_vInline, other.m_vInline, other.m_nSize);
+					}
+					else
+					{
+						m_pData = other.m_pData;
+						m_nCapacity = other.m_nCapacity;
+						other.m_pData = other.m_vInline;
+						other.m_nCapacity = InlineSize;
+					}
+
+					m_nSize = other.m_nSize;
+					other.m_nSize = 0;
+				}
+
+			private:
+				uint8_t *m_pData = m_vInline;
+				size_t m_nSize = 0;
+				size_t m_nCapacity = InlineSize;
+				alignas(8) uint8_t m_vInline[InlineSize];
+		};
+	}
+}
@@ -2,14 +2,41 @@
 
 #include "net_common.hpp"
 #include "net_tsqueue.hpp"
+#include "net_mpscqueue.hpp"
 #include "net_message.hpp"
 #include "net_connection.hpp"
+#include "net_iopool.hpp"
+#include "net_slotmap.hpp"
+#include "net_timer.hpp"
+#include "net_log.hpp"
+#include "net_metrics.hpp"
+#include "net_prometheus.hpp"
 
 namespace olc
 {
 	namespace net
 	{
-		template <typename T>
+		// Counters for incoming connections
+		struct accept_stats
+		{
+			uint64_t nAccepted = 0;
+			uint64_t nDenied = 0;
+			uint64_t nErrors = 0;
+			size_t nAcceptors = 0;
+
+			// Accepts per second since Start
+			double dAcceptRate = 0.0;
+
+			// Listen queue overflows and drops as counted by the kernel. These
+			// are host-wide, not just this server, and only available on Linux
+			uint64_t nListenOverflows = 0;
+			uint64_t nListenDrops = 0;
+		};
+
+		// QueueIn is the queue the connections feed and Update drains. The default
+		// tsqueue is fine for one io thread; ocl::net::mpsc_queue avoids the lock
+		// when several threads produce into it
+		template <typename T, typename QueueIn = ocl::net::tsqueue<owned_message<T>>>
 		class server_interface
 		{
 			public:
@@ -18,6 +45,17 @@ namespace olc
 				server_interface(uint16_t port)
 					: m_asioAcceptor(m_asioContext, boost::asio::ip::tcp::endpoint(boost::asio::ip::tcp::v4(), port))
 				{
+					// Things that are already counted elsewhere are read when asked for
+					m_metrics.Gauge("olc_net_incoming_queue_messages", "Messages waiting for Update",
+						[this]() { return (int64_t(m_backpressure.GetStats().nItems)); });
+					m_metrics.Gauge("olc_net_incoming_queue_bytes", "Bytes of messages waiting for Update",
+						[this]() { return (int64_t(m_backpressure.GetStats().nBytes)); });
+					m_metrics.Gauge("olc_net_paused_connections", "Connections not reading until the incoming queue drains",
+						[this]() { return (int64_t(m_backpressure.GetStats().nPausedConnections)); });
+					m_metrics.Gauge("olc_net_timers_pending", "Timers waiting on the timer wheel",
+						[this]() { return (int64_t(m_timers.GetStats().nPending)); });
+					m_metrics.Gauge("olc_net_timer_lag_microseconds", "How late the timer wheel last turned",
+						[this]() { return (int64_t(m_timers.GetStats().tLagLast.count())); });
 
 				}
 
@@ -26,179 +64,782 @@ namespace olc
 					Stop();
 				}
 
+				// Runs connections on nThreads io threads of their own instead of on
+				// the acceptor's thread, call before Start. Each connection stays on
+				// one thread, so OnMessage/Update see no difference
+				void SetIoThreads(size_t nThreads, io_assignment mode = io_assignment::round_robin)
+				{
+					m_nIoThreads = nThreads;
+					m_ioAssignment = mode;
+				}
+
+				// Number of connections on each io thread, empty without a pool
+				std::vector<size_t> GetIoLoads() const
+				{
+					return (m_ioPool.GetLoads());
+				}
+
 				bool Start()
 				{
 					try
 					{
+						if (m_nIoThreads > 1)
+							m_ioPool.Start(m_nIoThreads);
+
+						OpenAcceptorPerThread();
+						m_tpStarted = std::chrono::steady_clock::now();
+
+						m_timers.Start();
+
 						WaitForClientConnection();
 
+						if (m_nMetricsPort != 0)
+							m_metricsEndpoint.Start(m_nMetricsPort, m_sMetricsAddress);
+
 						m_threadContext = std::thread([this]() {m_asioContext.run(); });
 					}
 					catch (std::exception& e)
 					{
 						// Something prohibited the server from listening
-						std::cerr << "[SERVER] Exception: " << e.what() << "\n";
+						OLC_NET_LOG_ERROR("[SERVER] Exception: {}", e.what());
 						return (false);
 					}
 
-					std::cout << "[SERVER] Started!\n";
+					OLC_NET_LOG_INFO("[SERVER] Started!");
 					return (true);
 				}
 
 				void Stop()
 				{
 					// Request the context to close
+					m_timers.Stop();
 					m_asioContext.stop();
 
 					// Tidy up the context thread
 					if (m_threadContext.joinable()) m_threadContext.join();
+					m_metricsEndpoint.Stop();
+
+					// ...and the connections' threads, if they have their own
+					m_ioPool.Stop();
+
+					// Nothing more is coming, so don't leave Update waiting for it
+					Wake();
 
 					// Inform someone, anybody, if the care...
-					std::cout << "[SERVER] Stopped!\n";
+					OLC_NET_LOG_INFO("[SERVER] Stopped!");
 				}
 
 				// ASYNC - Instruct asio to wait for connection
 				void WaitForClientConnection()
 				{
-					m_asioAcceptor.async_accept(
-						[this](std::error_code ec, boost::asio::ip::tcp::socket socket)
-						{
-							if (!ec)
-							{
-								std::cout << "[SERVER] New Connection: " << socket.remote_endpoint() << "\n";
+					if (m_vAcceptors.empty())
+					{
+						if (std::error_code ec = apply_listen_options(m_asioAcceptor, m_sockOptions))
+							OLC_NET_LOG_WARN("[SERVER] Socket Options: {}", ec);
+						if (m_sockOptions.nListenBacklog > 0)
+							m_asioAcceptor.listen(m_sockOptions.nListenBacklog);
 
-								std::shared_ptr<connection<T>> newconn =
-									std::make_shared<connection<T>>(connection<T>::owner::server,
-										m_asioContext, std::move(socket), m_qMessagesIn);
+						AcceptOn(m_asioAcceptor, nullptr);
+					}
+					else
+					{
+						// One accept chain per io thread, each on its own listening
+						// socket, and the kernel spreads the new connections
+						for (size_t i = 0; i < m_vAcceptors.size(); i++)
+							AcceptOn(*m_vAcceptors[i], &m_ioPool.Context(i));
+					}
+				}
 
-								// Give the user server a chance to deny connection
-								if (OnClientConnect(newconn))
-								{
-									 // Connection allowed, so add to container of new conenctions
-									m_deqConnections.push_back(std::move(newconn));
+				// Listen on a separate SO_REUSEPORT socket on every io thread, rather
+				// than funnelling all accepts through one. OnClientConnect is then
+				// called from all of them at once. Needs SetIoThreads, and is
+				// ignored where the platform has no SO_REUSEPORT. Call before Start
+				void SetAcceptorPerThread(bool bEnable)
+				{
+					m_bAcceptorPerThread = bEnable;
+				}
 
-									m_deqConnections.back()->ConnectToClient(nIDCounter++);
+				// After each accept completes, take up to this many more connections
+				// that are already waiting, without going back through the reactor
+				void SetAcceptBatch(size_t nBatch)
+				{
+					m_nAcceptBatch = nBatch;
+				}
 
-									std::cout << "[" << m_deqConnections.back()->GetID() << "] Connection Approved\n";
-								}
-								else
+				accept_stats GetAcceptStats()
+				{
+					accept_stats stats;
+					stats.nAccepted = m_nAccepted.value();
+					stats.nDenied = m_nDenied.value();
+					stats.nErrors = m_nAcceptErrors.value();
+					stats.nAcceptors = std::max<size_t>(m_vAcceptors.size(), 1);
+
+					double dSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_tpStarted).count();
+					stats.dAcceptRate = dSeconds > 0.0 ? double(stats.nAccepted) / dSeconds : 0.0;
+
+					ReadListenOverflows(stats.nListenOverflows, stats.nListenDrops);
+					return (stats);
+				}
+
+			private:
+				// Swaps the single acceptor for one SO_REUSEPORT acceptor per pool
+				// context, all bound to the same endpoint
+				void OpenAcceptorPerThread()
+				{
+#ifdef SO_REUSEPORT
+					if (!m_bAcceptorPerThread || m_ioPool.size() == 0)
+						return;
+
+					using reuse_port = boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>;
+
+					boost::asio::ip::tcp::endpoint endpoint = m_asioAcceptor.local_endpoint();
+					m_asioAcceptor.close();
+
+					for (size_t i = 0; i < m_ioPool.size(); i++)
+					{
+						auto acceptor = std::make_unique<boost::asio::ip::tcp::acceptor>(m_ioPool.Context(i));
+						acceptor->open(endpoint.protocol());
+						acceptor->set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+						acceptor->set_option(reuse_port(true));
+						apply_listen_options(*acceptor, m_sockOptions);
+						acceptor->bind(endpoint);
+						acceptor->listen(m_sockOptions.nListenBacklog > 0 ? m_sockOptions.nListenBacklog : boost::asio::socket_base::max_listen_connections);
+						m_vAcceptors.push_back(std::move(acceptor));
+					}
+#endif
+				}
+
+				// The pool context the next socket accepted on an acceptor goes to, or
+				// nNoPool for the acceptor's own. An acceptor that has a context of
+				// its own keeps its connections there; otherwise a pool thread if
+				// there is a pool, otherwise ours. The socket is accepted straight
+				// onto it, and only counted against it once it has been, so a
+				// pending or failed accept never takes a turn or carries load
+				static constexpr size_t nNoPool = size_t(-1);
+
+				size_t NextForAccept(boost::asio::io_context *pOwn) const
+				{
+					if (pOwn || m_ioPool.size() == 0)
+						return (nNoPool);
+					return (m_ioPool.Next(m_ioAssignment));
+				}
+
+				boost::asio::io_context &ContextForAccept(boost::asio::io_context *pOwn, size_t nPool)
+				{
+					if (pOwn)
+						return (*pOwn);
+					return (nPool == nNoPool ? m_asioContext : m_ioPool.Context(nPool));
+				}
+
+				// ASYNC - Wait for a connection on one acceptor, then drain whatever
+				// else is already in its backlog before waiting again
+				void AcceptOn(boost::asio::ip::tcp::acceptor &acceptor, boost::asio::io_context *pOwn)
+				{
+					size_t nPool = NextForAccept(pOwn);
+					acceptor.async_accept(ContextForAccept(pOwn, nPool),
+						[this, &acceptor, pOwn, nPool](std::error_code ec, boost::asio::ip::tcp::socket socket)
+						{
+							if (!ec)
+							{
+								OnAccepted(std::move(socket), pOwn, nPool);
+
+								// Connections queued up behind this one can be taken
+								// straight away with non-blocking accepts
+								acceptor.non_blocking(true);
+								for (size_t i = 0; i < m_nAcceptBatch; i++)
 								{
-									std::cout << "[-----] Connection Denied\n";
+									size_t nNext = NextForAccept(pOwn);
+									boost::system::error_code ecNext;
+									boost::asio::ip::tcp::socket next = acceptor.accept(ContextForAccept(pOwn, nNext), ecNext);
+									if (ecNext)
+									{
+										if (ecNext != boost::asio::error::would_block && ecNext != boost::asio::error::try_again)
+											m_nAcceptErrors.inc();
+										break;
+									}
+									OnAccepted(std::move(next), pOwn, nNext);
 								}
 							}
 							else
 							{
 								// Error has occured during acceptance
-								std::cout << "[SERVER] New Connection Error: " << ec.message() << "\n";
+								OLC_NET_LOG_WARN("[SERVER] New Connection Error: {}", ec);
+								m_nAcceptErrors.inc();
+
+								// The acceptor is gone, e.g. the server is stopping
+								if (ec == std::errc::operation_canceled)
+									return;
 							}
 
 							// Prime the asio context with more work - again simply wait for
 							// another connection..
-							WaitForClientConnection();
+							AcceptOn(acceptor, pOwn);
 						});
 				}
 
+				// Takes on a freshly accepted socket, already on the context
+				// ContextForAccept gave it, and counts it there
+				void OnAccepted(boost::asio::ip::tcp::socket socket, boost::asio::io_context *pOwn, size_t nPool)
+				{
+					m_nAccepted.inc();
+					boost::asio::io_context &ioContext = pOwn ? m_ioPool.Acquire(*pOwn)
+						: nPool != nNoPool ? m_ioPool.Acquire(nPool) : m_asioContext;
+
+					std::shared_ptr<connection<T>> newconn =
+						std::make_shared<connection<T>>(connection<T>::owner::server,
+							ioContext, std::move(socket), m_qMessagesIn, &m_backpressure);
+					newconn->SetRateLimit(m_rateLimit);
+					newconn->SetSocketOptions(m_sockOptions);
+					newconn->SetMetrics(&m_connectionMetrics);
+
+					// Give the user server a chance to deny connection
+					if (OnClientConnect(newconn))
+					{
+						// Connection allowed, so add to container of new conenctions.
+						// Several acceptors may get here at once. Its slot key is
+						// its ID from here on
+						std::scoped_lock lock(m_muxConnections);
+						uint64_t nID = m_mapConnections.insert({ newconn });
+						if (nID != 0)
+						{
+							m_gConnections.add(1);
+							newconn->ConnectToClient(nID);
+							ArmClientTimers(nID);
+							OLC_NET_LOG_INFO("[{}] Connection Approved", nID);
+							return;
+						}
+					}
+
+					OLC_NET_LOG_INFO("[-----] Connection Denied");
+					m_ioPool.Release(ioContext);
+					m_nDenied.inc();
+				}
+
+				// Host-wide listen queue overflow and drop counts from the kernel,
+				// where it publishes them
+				static void ReadListenOverflows(uint64_t &nOverflows, uint64_t &nDrops)
+				{
+					nOverflows = nDrops = 0;
+#ifdef __linux__
+					std::ifstream file("/proc/net/netstat");
+					std::string sNames, sValues;
+					while (std::getline(file, sNames) && std::getline(file, sValues))
+					{
+						if (sNames.rfind("TcpExt:", 0) != 0)
+							continue;
+
+						std::istringstream names(sNames), values(sValues);
+						std::string sName, sValue;
+						while (names >> sName && values >> sValue)
+						{
+							if (sName == "ListenOverflows") nOverflows = std::stoull(sValue);
+							if (sName == "ListenDrops") nDrops = std::stoull(sValue);
+						}
+					}
+#endif
+				}
+
+			public:
 				// Send a message to a specific client
-				void MessageClient(std::shared_ptr <connection<T>> client, const message<T> &msg)
+				void MessageClient(std::shared_ptr <connection<T>> client, const message<T> &msg, priority prio = priority::normal)
+				{
+					MessageClient(std::move(client), message<T>(msg), prio);
+				}
+
+				// As above, but the message body is moved through to the socket
+				void MessageClient(std::shared_ptr <connection<T>> client, message<T> &&msg, priority prio = priority::normal)
 				{
 					if (client && client->IsConnected())
 					{
-						client->Send(msg);
+						client->Send(std::move(msg), prio);
 					}
-					else
+					else if (client)
 					{
-						OnClientDisconnect(client);
-						client.reset();
-						m_deqConnections.erase(
-							std::remove(m_deqConnections.begin(), m_deqConnections.end(), client), m_deqConnections.end());
+						RemoveClient(client);
 					}
 				}
 
-				// Send message to all clients
-				void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
+				// Send a message to a client by its ID
+				void MessageClient(uint64_t nClientID, const message<T> &msg, priority prio = priority::normal)
+				{
+					MessageClient(nClientID, message<T>(msg), prio);
+				}
+
+				void MessageClient(uint64_t nClientID, message<T> &&msg, priority prio = priority::normal)
+				{
+					std::shared_ptr<connection<T>> client;
+					{
+						std::scoped_lock lock(m_muxConnections);
+						if (auto pEntry = m_mapConnections.find(nClientID))
+							client = pEntry->client;
+					}
+
+					if (client)
+						MessageClient(std::move(client), std::move(msg), prio);
+				}
+
+				// Looks up a connected client by its ID, nullptr if there is none
+				std::shared_ptr<connection<T>> GetClient(uint64_t nClientID)
 				{
-					bool bInvalidClientExists = false;
+					std::scoped_lock lock(m_muxConnections);
+					auto pEntry = m_mapConnections.find(nClientID);
+					return (pEntry ? pEntry->client : nullptr);
+				}
 
-					for (auto& client : m_deqConnections)
+				// Send message to all clients
+				void MessageAllClients(const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr, priority prio = priority::normal)
+				{
+					std::vector<std::shared_ptr<connection<T>>> vDisconnected;
 					{
-						// Check client is connected...
-						if (client && client->IsConnected())
-						{
-							// ..it is!
-							if (client != pIgnoreClient)
-								client->Send(msg);
-						}
-						else
+						std::scoped_lock lock(m_muxConnections);
+
+						for (auto& entry : m_mapConnections)
 						{
-							// The client couldn't be contacted, so assume it 
-							// has disconnected
-							OnClientDisconnect(client);
-							client.reset();
-							bInvalidClientExists = true;
+							auto &client = entry.client;
+
+							// Check client is connected...
+							if (client && client->IsConnected())
+							{
+								// ..it is!
+								if (client != pIgnoreClient)
+									client->Send(msg, prio);
+							}
+							else
+							{
+								// The client couldn't be contacted, so assume it
+								// has disconnected
+								vDisconnected.push_back(client);
+							}
 						}
+
+						for (auto &client : vDisconnected)
+							EraseClient(client->GetID());
 					}
 
-					if (bInvalidClientExists)
+					// Tell the user outside the lock, they may well message someone
+					for (auto &client : vDisconnected)
 					{
-						// TODO: check last parameter
-						m_deqConnections.erase(std::remove(m_deqConnections.begin(), m_deqConnections.end(), nullptr), m_deqConnections.end());
+						OnClientDisconnect(client);
+						if (client) m_ioPool.Release(client->GetContext());
 					}
 				}
 
-				void Update(size_t nMaxMessages = -1)
+				// Dispatches up to nMaxMessages queued messages to OnMessage. If bWait
+				// is set, sleeps until at least one message arrives rather than
+				// returning straight away with nothing to do, or until Wake
+				void Update(size_t nMaxMessages = -1, bool bWait = false)
 				{
+					if (bWait) m_qMessagesIn.wait();
+
+					ReportTimedOut();
+
 					size_t nMessageCount = 0;
-					while (nMessageCount < nMaxMessages && !m_qMessagesIn.empty())
+					while (nMessageCount < nMaxMessages)
 					{
-						// Grab the front message
-						auto msg = m_qMessagesIn.pop_front();
+						// Grab a batch of messages in one go, so the queue is only
+						// locked once per batch rather than twice per message
+						size_t nBatch = m_qMessagesIn.drain(m_vUpdateBatch, std::min(nMaxMessages - nMessageCount, nUpdateBatchSize));
+						if (nBatch == 0)
+							break;
+
+						// Pass each to message handler, timing them back to back so
+						// it's one clock read per message
+						size_t nBatchBytes = 0;
+						auto tpLast = std::chrono::steady_clock::now();
+						for (auto &msg : m_vUpdateBatch)
+						{
+							// OnMessage is free to take the message apart, look first
+							message_id_metrics &idMetrics = MessageIdMetrics(uint64_t(msg.msg.header.id));
+							idMetrics.pMessages->inc();
+							idMetrics.pBytes->inc(msg.msg.size());
+
+							nBatchBytes += msg.msg.size();
+							OnMessage(msg.remote, msg.msg);
+
+							auto tpNow = std::chrono::steady_clock::now();
+							m_hOnMessage.record(uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(tpNow - tpLast).count()));
+							tpLast = tpNow;
+						}
+						m_nDequeued.inc(nBatch);
 
-						// Pass to message handler
-						OnMessage(msg.remote, msg.msg);
+						// Let any connections parked by backpressure read again
+						m_backpressure.OnDequeue(nBatch, nBatchBytes);
 
-						nMessageCount++;
+						// Keep the capacity for next time, but let go of the connections
+						m_vUpdateBatch.clear();
+						nMessageCount += nBatch;
 					}
 				}
 
+				// Gets an Update that is waiting for messages to return without any,
+				// from any thread. If none is waiting, the next one won't. Stop
+				// calls it, so a thread sitting in Update(-1, true) can be shut down
+				void Wake()
+				{
+					m_qMessagesIn.wake();
+				}
+
+				// Tunes each accepted socket, and the listening ones where that
+				// helps, see socket_options. Call before Start
+				void SetSocketOptions(const socket_options &options)
+				{
+					m_sockOptions = options;
+				}
+
+				// Rate limits each new client's messages, see connection::SetRateLimit.
+				// OnClientConnect may set a client's own instead. Call before Start
+				void SetRateLimit(const rate_limit_config &config)
+				{
+					m_rateLimit = config;
+				}
+
+				// Disconnects any client that has sent nothing for this long, so dead
+				// peers don't linger until a send to them fails. The next Update
+				// calls OnClientDisconnect for it. Zero, the default, never times
+				// out. Call before Start
+				void SetIdleTimeout(std::chrono::milliseconds tTimeout)
+				{
+					m_tIdleTimeout = tTimeout;
+				}
+
+				// Calls OnClientHeartbeat for each client this often, counted from
+				// when it connected. Zero, the default, turns it off. Call before Start
+				void SetHeartbeat(std::chrono::milliseconds tInterval)
+				{
+					m_tHeartbeat = tInterval;
+				}
+
+				// Pings every client this often, counted from when it connected, so
+				// connection::GetRTT has numbers. Zero, the default, turns it off.
+				// The numbers only reflect the link with bNoDelay set in both ends'
+				// socket_options, see connection::Ping. Call before Start
+				void SetPingInterval(std::chrono::milliseconds tInterval)
+				{
+					m_tPing = tInterval;
+				}
+
+				// The server's timer service, for callbacks of your own. They run on
+				// the server's context thread
+				timer_wheel &GetTimers()
+				{
+					return (m_timers);
+				}
+
+				// Timer counts and how far behind the wheel is running
+				timer_stats GetTimerStats()
+				{
+					return (m_timers.GetStats());
+				}
+
+				// Sets the incoming queue watermarks, call before Start
+				void SetBackpressure(const backpressure_config &config)
+				{
+					m_backpressure.Configure(config);
+				}
+
+				// Every counter, gauge and histogram the server keeps, to export or
+				// to add your own to
+				metrics_registry &GetMetrics()
+				{
+					return (m_metrics);
+				}
+
+				// Serves GET /metrics in Prometheus' text format on a second port,
+				// from the acceptor's own io context so scrapes stay off the
+				// connections' threads when they have their own. Listens on
+				// loopback unless told otherwise, and renders at most once per
+				// tCache however often it is scraped. Call before Start
+				void SetMetricsEndpoint(uint16_t nPort, const std::string &sAddress = "127.0.0.1",
+					std::chrono::milliseconds tCache = std::chrono::milliseconds(1000))
+				{
+					m_nMetricsPort = nPort;
+					m_sMetricsAddress = sAddress;
+					m_metricsEndpoint.SetCacheTime(tCache);
+				}
+
+				// Current incoming queue depth and how often reads were paused
+				backpressure_stats GetBackpressureStats()
+				{
+					return (m_backpressure.GetStats());
+				}
+
 			protected:
 
-				// Called when a client connects, you can veto the connection by returning false
-				virtual bool OnClientConnect(std::shared_ptr<connection<T>> client)
+				// Called when a client connects, you can veto the connection by returning false.
+				// Runs on the thread that accepted it. With SetAcceptorPerThread that is
+				// each io thread in turn, so calls can overlap one another as well as
+				// Update
+				virtual bool OnClientConnect(std::shared_ptr<connection<T>>)
 				{
 					return (false);
 				}
 
-				// Called when a client appears to have disconnected
-				virtual void OnClientDisconnect(std::shared_ptr<connection<T>> client)
+				// Called when a client appears to have disconnected, on the thread
+				// that found out: MessageClient's or MessageAllClients', or Update's
+				// for the idle timeout
+				virtual void OnClientDisconnect(std::shared_ptr<connection<T>>)
 				{
 				}
 
 				// Called when a message arrives
-				virtual void OnMessage(std::shared_ptr<connection<T>> client, message<T>& msg)
+				virtual void OnMessage(std::shared_ptr<connection<T>>, message<T>&)
 				{
 
 				}
 
-			protected:
-				// Thread Safe Queue for incoming message packets
-				ocl::net::tsqueue<owned_message<T>>		m_qMessagesIn;
+				// Called every heartbeat interval for each client, see SetHeartbeat.
+				// Runs on the server's context thread, not from Update
+				virtual void OnClientHeartbeat(std::shared_ptr<connection<T>>)
+				{
+
+				}
+
+			private:
+				// Starts a new client's idle, heartbeat and ping timers, m_muxConnections
+				// must be held
+				void ArmClientTimers(uint64_t nID)
+				{
+					client_entry *pEntry = m_mapConnections.find(nID);
+					if (m_tIdleTimeout.count() > 0)
+						pEntry->nIdleTimer = m_timers.Schedule(m_tIdleTimeout, [this, nID]() { CheckIdle(nID); });
+
+					if (m_tHeartbeat.count() > 0)
+						pEntry->nHeartbeatTimer = m_timers.ScheduleEvery(m_tHeartbeat,
+							[this, nID]()
+							{
+								if (auto client = GetClient(nID); client && client->IsConnected())
+									OnClientHeartbeat(std::move(client));
+							});
+
+					if (m_tPing.count() > 0)
+						pEntry->nPingTimer = m_timers.ScheduleEvery(m_tPing,
+							[this, nID]()
+							{
+								if (auto client = GetClient(nID); client && client->IsConnected())
+									client->Ping();
+							});
+				}
+
+				// Idle timer callback. Rather than pushing the timer back on every
+				// read, it looks at when the client last read anything, and either
+				// drops it or re-arms for the rest of the timeout
+				void CheckIdle(uint64_t nID)
+				{
+					std::shared_ptr<connection<T>> client;
+					timer_id nTimer = 0;
+					{
+						std::scoped_lock lock(m_muxConnections);
+						auto pEntry = m_mapConnections.find(nID);
+						if (!pEntry)
+							return;
+						client = pEntry->client;
+						nTimer = pEntry->nIdleTimer;
+					}
 
-				// Container of active validated connections
-				std::deque<std::shared_ptr<connection<T>>> m_deqConnections;
+					// A throttled or parked client isn't being read, so it can't
+					// look active
+					if (client->IsConnected() && (client->IsThrottled() || client->IsParked()))
+					{
+						m_timers.Reschedule(nTimer, m_tIdleTimeout);
+						return;
+					}
+
+					auto tIdle = std::chrono::steady_clock::now() - client->GetLastActivity();
+					if (client->IsConnected() && tIdle < m_tIdleTimeout)
+					{
+						m_timers.Reschedule(nTimer, m_tIdleTimeout - tIdle);
+						return;
+					}
+
+					OLC_NET_LOG_INFO("[{}] Idle Timeout.", nID);
+					client->Disconnect();
+
+					// Update tells the user, so OnClientDisconnect stays on its thread
+					{
+						std::scoped_lock lock(m_muxConnections);
+						if (!EraseClient(nID))
+							return;
+						m_vTimedOut.push_back(client);
+					}
+					m_ioPool.Release(client->GetContext());
+					Wake();
+				}
+
+				// Calls OnClientDisconnect for the clients the idle timeout dropped
+				// since the last Update
+				void ReportTimedOut()
+				{
+					{
+						std::scoped_lock lock(m_muxConnections);
+						if (m_vTimedOut.empty())
+							return;
+						m_vReporting.swap(m_vTimedOut);
+					}
+
+					for (auto &client : m_vReporting)
+						OnClientDisconnect(client);
+					m_vReporting.clear();
+				}
+
+				// Takes a client out of the server and tells the user, unless
+				// something else got there first
+				void RemoveClient(const std::shared_ptr<connection<T>> &client)
+				{
+					{
+						std::scoped_lock lock(m_muxConnections);
+						if (!EraseClient(client->GetID()))
+							return;
+					}
+
+					OnClientDisconnect(client);
+					m_ioPool.Release(client->GetContext());
+				}
+
+				// m_muxConnections must be held
+				bool EraseClient(uint64_t nID)
+				{
+					client_entry *pEntry = m_mapConnections.find(nID);
+					if (!pEntry)
+						return (false);
+
+					if (pEntry->nIdleTimer) m_timers.Cancel(pEntry->nIdleTimer);
+					if (pEntry->nHeartbeatTimer) m_timers.Cancel(pEntry->nHeartbeatTimer);
+					if (pEntry->nPingTimer) m_timers.Cancel(pEntry->nPingTimer);
+					m_gConnections.sub(1);
+					return (m_mapConnections.erase(nID));
+				}
+
+				// Counters for messages handled with a given id, registered the
+				// first time it is seen. Ids come off the wire, so past
+				// nMaxTrackedIds they all count as "other" rather than letting a
+				// client grow the registry without end. Update's thread only
+				struct message_id_metrics
+				{
+					counter *pMessages = nullptr;
+					counter *pBytes = nullptr;
+				};
+
+				message_id_metrics &MessageIdMetrics(uint64_t nID)
+				{
+					auto it = m_mapIdMetrics.find(nID);
+					if (it != m_mapIdMetrics.end())
+						return (it->second);
+
+					if (m_mapIdMetrics.size() >= nMaxTrackedIds)
+					{
+						if (!m_idMetricsOther.pMessages)
+							m_idMetricsOther = RegisterIdMetrics("id=\"other\"");
+						return (m_idMetricsOther);
+					}
+					return (m_mapIdMetrics.emplace(nID, RegisterIdMetrics("id=\"" + std::to_string(nID) + "\"")).first->second);
+				}
 
-				// Order of declaration is important - it's also the order of initialisation
+				message_id_metrics RegisterIdMetrics(const std::string &sLabels)
+				{
+					return (message_id_metrics
+					{
+						&m_metrics.Counter("olc_net_handled_messages_total", "Messages passed to OnMessage, by message id", sLabels),
+						&m_metrics.Counter("olc_net_handled_bytes_total", "Bytes of messages passed to OnMessage, by message id", sLabels)
+					});
+				}
+
+				// A connection and the timers that belong to it
+				struct client_entry
+				{
+					std::shared_ptr<connection<T>> client;
+					timer_id nIdleTimer = 0;
+					timer_id nHeartbeatTimer = 0;
+					timer_id nPingTimer = 0;
+				};
+
+			protected:
+				// Declared first so it outlives anything that records into it
+				metrics_registry				m_metrics;
+
+				// Optional extra io threads for the connections, see SetIoThreads.
+				// Declared ahead of everything that holds connections, so it
+				// outlives their sockets
+				io_context_pool					m_ioPool;
+				size_t							m_nIoThreads = 1;
+				io_assignment					m_ioAssignment = io_assignment::round_robin;
+
+				// Order of declaration is important - it's also the order of initialisation.
+				// Without a pool the connections' sockets and timers live on this
+				// context too, so it comes before everything that holds them
 				boost::asio::io_context			m_asioContext;
 				std::thread						m_threadContext;
 
+				// Thread Safe Queue for incoming message packets
+				QueueIn		m_qMessagesIn;
+
+				// Messages taken from m_qMessagesIn by Update, waiting to be handled
+				std::vector<owned_message<T>>	m_vUpdateBatch;
+				static constexpr size_t			nUpdateBatchSize = 256;
+
+				// Depth of m_qMessagesIn, and the connections waiting for it to drain
+				backpressure<T>					m_backpressure;
+				rate_limit_config				m_rateLimit;
+				socket_options					m_sockOptions;
+
+				// Container of active validated connections, keyed by connection ID,
+				// guarded as acceptors and Update may touch it from different threads
+				slot_map<client_entry> m_mapConnections;
+				std::mutex m_muxConnections;
+
+				// Clients dropped by the idle timeout, for Update to report. The
+				// second is Update's own, swapped with the first under the lock
+				std::vector<std::shared_ptr<connection<T>>> m_vTimedOut;
+				std::vector<std::shared_ptr<connection<T>>> m_vReporting;
+				std::chrono::milliseconds m_tIdleTimeout{ 0 };
+				std::chrono::milliseconds m_tHeartbeat{ 0 };
+				std::chrono::milliseconds m_tPing{ 0 };
+
+				// Every connection's timers, turned by the one context
+				timer_wheel						m_timers{ m_asioContext };
+
 				// These things need an asio context
 				boost::asio::ip::tcp::acceptor	m_asioAcceptor;
 
-				// Clients will be identified in the "wider system" via an ID
-				uint32_t nIDCounter = 10000;
+				// Per io thread SO_REUSEPORT acceptors, replacing m_asioAcceptor
+				// when SetAcceptorPerThread is on
+				std::vector<std::unique_ptr<boost::asio::ip::tcp::acceptor>> m_vAcceptors;
+				bool m_bAcceptorPerThread = false;
+				size_t m_nAcceptBatch = 16;
+
+				counter &m_nAccepted = m_metrics.Counter("olc_net_accepted_total", "Connections accepted");
+				counter &m_nDenied = m_metrics.Counter("olc_net_denied_total", "Connections turned away by OnClientConnect or a full registry");
+				counter &m_nAcceptErrors = m_metrics.Counter("olc_net_accept_errors_total", "Accepts that failed");
+				gauge &m_gConnections = m_metrics.Gauge("olc_net_connections", "Connected clients");
+				counter &m_nDequeued = m_metrics.Counter("olc_net_messages_dequeued_total", "Messages taken off the incoming queue by Update");
+				histogram &m_hOnMessage = m_metrics.Histogram("olc_net_onmessage_nanoseconds", "Time spent in each OnMessage");
+
+				// Per message id counters, see MessageIdMetrics
+				static constexpr size_t nMaxTrackedIds = 256;
+				std::unordered_map<uint64_t, message_id_metrics> m_mapIdMetrics;
+				message_id_metrics m_idMetricsOther;
+
+				// GET /metrics on a second port, see SetMetricsEndpoint
+				metrics_endpoint m_metricsEndpoint{ m_asioContext, m_metrics };
+				uint16_t m_nMetricsPort = 0;
+				std::string m_sMetricsAddress;
+
+				// What every connection records into
+				connection_metrics m_connectionMetrics
+				{
+					&m_metrics.Counter("olc_net_read_bytes_total", "Bytes read from clients"),
+					&m_metrics.Counter("olc_net_written_bytes_total", "Bytes written to clients"),
+					&m_metrics.Counter("olc_net_reads_total", "Socket reads that returned data"),
+					&m_metrics.Counter("olc_net_writes_total", "Socket writes"),
+					&m_metrics.Counter("olc_net_messages_enqueued_total", "Messages read and put on the incoming queue"),
+					&m_metrics.Counter("olc_net_messages_sent_total", "Messages written to clients"),
+					&m_metrics.Counter("olc_net_connection_errors_total", "Failed reads and writes, including clients going away, and bad headers"),
+					&m_metrics.Histogram("olc_net_write_batch_messages", "Messages per completed gathered write")
+				};
+				std::chrono::steady_clock::time_point m_tpStarted = std::chrono::steady_clock::now();
 		};
 
 
-		template <typename T>
+		template <typename T, typename QueueIn = ocl::net::tsqueue<owned_message<T>>>
 		class client_interface
 		{
 			public:
@@ -215,13 +856,21 @@ namespace olc
 				}
 
 			public:
+				// Tunes the connection's socket, see socket_options. Call before Connect
+				void SetSocketOptions(const socket_options &options)
+				{
+					m_sockOptions = options;
+				}
+
 				// Connect to server with hostname/ip-address and port
 				bool Connect(const std::string &host, const uint16_t port)
 				{
 					try
 					{
 						// Create connection
-						m_connection = std::make_unique<connection<T>>(); // TODO
+						m_connection = std::make_shared<connection<T>>(connection<T>::owner::client,
+							m_context, boost::asio::ip::tcp::socket(m_context), m_qMessagesIn);
+						m_connection->SetSocketOptions(m_sockOptions);
 
 						// Resolve hostname/ip-address into tangible physical address
 						boost::asio::ip::tcp::resolver					resolver(m_context);
@@ -236,7 +885,7 @@ namespace olc
 					}
 					catch (std::exception &e)
 					{
-						std::cerr << "Client Exception: " << e.what() << "\n";
+						OLC_NET_LOG_ERROR("Client Exception: {}", e.what());
 						return (false);
 					}
 
@@ -260,7 +909,7 @@ namespace olc
 						thrContext.join();
 
 					// Destroy the connection object
-					m_connection.release();
+					m_connection.reset();
 				}
 
 				// Check if client is actually connected to a server
@@ -273,7 +922,7 @@ namespace olc
 				}
 
 				// Retrieve queue of messages from server
-				ocl::net::tsqueue<owned_message<T>> &Incoming()
+				QueueIn &Incoming()
 				{
 					return (m_qMessagesIn);
 				}
@@ -286,11 +935,12 @@ namespace olc
 				// This is the hardware socket that is connected to the server
 				boost::asio::ip::tcp::socket m_socket;
 				// The client has a single instance of a "connection" object, which handles data transfer
-				std::unique_ptr<connection<T>> m_connection;
+				std::shared_ptr<connection<T>> m_connection;
+				socket_options m_sockOptions;
 
 			private:
 				// This is the thread safe queue of incoming messages from server
-				ocl::net::tsqueue<owned_message<T>> m_qMessagesIn;
+				QueueIn m_qMessagesIn;
 		};
 	}
 }
\ No newline at end of file
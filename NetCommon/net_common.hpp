@@ -3,15 +3,32 @@
 
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <new>
 #include <deque>
+#include <unordered_map>
 #include <optional>
 #include <vector>
+#include <array>
 #include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <stdexcept>
 #include <algorithm>
+#include <functional>
+#include <cmath>
 #include <chrono>
 #include <cstdint>
+#include <cstring>
+#include <limits>
+#include <type_traits>
 
-#ifndef _WIN32
+#ifdef _WIN32
 #define _WIN32_WINNT 0x0A00
 #endif
 
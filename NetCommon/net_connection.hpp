@@ -3,11 +3,30 @@
 #include "net_common.hpp"
 #include "net_tsqueue.hpp"
 #include "net_message.hpp"
+#include "net_wire.hpp"
+#include "net_backpressure.hpp"
+#include "net_lanes.hpp"
+#include "net_rtt.hpp"
+#include "net_ratelimit.hpp"
+#include "net_sockopt.hpp"
+#include "net_log.hpp"
+#include "net_metrics.hpp"
 
 namespace olc
 {
 	namespace net
 	{
+		// Corked, Send only queues, and the queue goes out once it holds
+		// nFlushBytes or tFlushDelay after the first message waiting - whichever
+		// is sooner. Trades latency for fewer, larger writes. Control priority
+		// messages are never held back
+		struct cork_config
+		{
+			bool bEnabled = false;
+			size_t nFlushBytes = 64 * 1024;
+			std::chrono::microseconds tFlushDelay{ 500 };
+		};
+
 		template <typename T>
 		class connection : public std::enable_shared_from_this<connection<T>>
 		{
@@ -18,166 +37,655 @@ namespace olc
 					client
 				};
 
-				connection(owner parent, boost::asio::io_context &asioContext, boost::asio::ip::tcp::socket socket, ocl::net::tsqueue<owned_message<T>> &qIn)
-					: m_asioContext(asioContext), m_socket(std::move(socket)), m_qMessagesIn(qIn)
+				connection(owner parent, boost::asio::io_context &asioContext, boost::asio::ip::tcp::socket socket, ocl::net::queue_sink<owned_message<T>> &qIn,
+					backpressure<T> *pBackpressure = nullptr)
+					: m_socket(std::move(socket)), m_asioContext(asioContext), m_qMessagesIn(qIn), m_timerCork(asioContext), m_pBackpressure(pBackpressure),
+					m_timerThrottle(asioContext)
 				{
 					m_nOwnerType = parent;
 				}
 
 				virtual ~connection() {}
 
-				uint32_t GetID() const
+				uint64_t GetID() const
 				{
 					return (id);
 				}
 
+				// The io context this connection's handlers run on
+				boost::asio::io_context &GetContext()
+				{
+					return (m_asioContext);
+				}
+
 			public:
-				void ConnectToClient(uint32_t uid = 0)
+				void ConnectToClient(uint64_t uid = 0)
 				{
 					if (m_nOwnerType == owner::server)
 					{
 						if (m_socket.is_open())
 						{
 							id = uid;
-							ReadHeader();
+
+							// Start reading on the connection's own context, which
+							// may not be the thread that accepted it
+							boost::asio::post(m_asioContext, [this, self = this->shared_from_this()]() { ReadMessages(); });
 						}
 					}
 				}
 
-				void ConnectToServer(const boost::asio::ip::tcp::resolver::results_type &endpoints);
+				void ConnectToServer(const boost::asio::ip::tcp::resolver::results_type &endpoints)
+				{
+					// Only clients can connect to servers
+					if (m_nOwnerType == owner::client)
+					{
+						// Request asio attempts to connect to an endpoint
+						boost::asio::async_connect(m_socket, endpoints,
+							[this, self = this->shared_from_this()](std::error_code ec, boost::asio::ip::tcp::endpoint)
+							{
+								if (!ec)
+								{
+									ApplySocketOptions();
+									ReadMessages();
+								}
+								else
+								{
+									OLC_NET_LOG_WARN("[{}] Connect Fail: {}", id, ec);
+								}
+							});
+					}
+				}
+
+				// Tunes the socket. A connected socket takes the options straight
+				// away, otherwise they are applied once ConnectToServer succeeds
+				void SetSocketOptions(const socket_options &options)
+				{
+					m_sockOptions = options;
+					if (m_socket.is_open())
+						ApplySocketOptions();
+				}
+				// Every handler the connection queues holds a reference to it, so it
+				// stays alive until the close and any aborted reads have run
 				void Disconnect()
 				{
 					if (IsConnected())
-						boost::asio::post(m_asioContext, [this]() { m_socket.close(); });
+						boost::asio::post(m_asioContext, [this, self = this->shared_from_this()]() { m_socket.close(); });
 				}
 				bool IsConnected() const
 				{
 					return (m_socket.is_open());
 				}
 
+				// Starts reading again after backpressure parked this connection
+				void ResumeReading()
+				{
+					boost::asio::post(m_asioContext,
+						[self = this->shared_from_this()]()
+						{
+							self->Touch();
+							self->m_bParked.store(false, std::memory_order_relaxed);
+
+							// Frames may already be sitting in the buffer
+							self->ParseMessages();
+						});
+				}
+
 			public:
-				void  Send(const message<T> &msg)
+				void Send(const message<T> &msg, priority prio = priority::normal)
+				{
+					Send(message<T>(msg), prio);
+				}
+
+				// The message is moved all the way onto the outgoing queue, so its
+				// body is never copied
+				void Send(message<T> &&msg, priority prio = priority::normal)
 				{
 					boost::asio::post(m_asioContext,
-						[this, msg]()
+						[this, self = this->shared_from_this(), msg = std::move(msg), prio]() mutable
 						{
-							bool bWritingMessage = !m_qMessagesOut.empty();
-							m_qMessagesOut.push_back(msg);
-							if (!bWritingMessage)
-							{
-								WriteHeader();
-							}
+							QueueOutgoing(std::move(msg), prio);
+						});
+				}
+
+				// Sends a framework ping, stamped now. The remote answers it without
+				// the user seeing it, and the round trip lands in GetRTT. Any time
+				// spent behind queued messages counts, so a congested connection
+				// shows up as a slow one. Both ends need socket_options::bNoDelay
+				// for the round trip to measure the link, otherwise Nagle and
+				// delayed acks can hold the ping or its answer back
+				void Ping()
+				{
+					message<T> msg;
+					msg.header.id = ping_id<T>();
+					msg << uint64_t(std::chrono::steady_clock::now().time_since_epoch().count()) << uint8_t(ping_kind::ping);
+					Send(std::move(msg), priority::control);
+				}
+
+				// Round trip times from Ping, safe to call from any thread
+				rtt_stats GetRTT() const
+				{
+					return (m_rtt.GetStats());
+				}
+
+				// Limits how fast this connection's messages are taken in. Over the
+				// limit it stops reading until its buckets refill, so the remote
+				// is slowed by TCP rather than losing anything. Call before the
+				// connection starts reading
+				void SetRateLimit(const rate_limit_config &config)
+				{
+					m_bucketMessages.Configure(config.dMessagesPerSecond, config.dMessageBurst);
+					m_bucketBytes.Configure(config.dBytesPerSecond, config.dByteBurst);
+				}
+
+				// Counters to record reads, writes and messages into, or nullptr
+				// for none. Call before the connection starts reading
+				void SetMetrics(const connection_metrics *pMetrics)
+				{
+					m_pMetrics = pMetrics;
+				}
+
+				rate_limit_stats GetRateLimitStats() const
+				{
+					rate_limit_stats stats;
+					stats.nThrottles = m_nThrottles.load(std::memory_order_relaxed);
+					stats.tThrottled = std::chrono::microseconds(m_nThrottledMicros.load(std::memory_order_relaxed));
+					return (stats);
+				}
+
+				// Turns corking on or off, see cork_config. Turning it off sends
+				// whatever is being held
+				void SetCork(const cork_config &config)
+				{
+					boost::asio::post(m_asioContext,
+						[this, self = this->shared_from_this(), config]()
+						{
+							m_cork = config;
+							StartWriting();
+						});
+				}
+
+				// Sends everything queued so far without waiting for the cork
+				void Flush()
+				{
+					boost::asio::post(m_asioContext,
+						[this, self = this->shared_from_this()]()
+						{
+							m_bFlushPending = true;
+							StartWriting();
 						});
 				}
 
+				// Chooses how the outgoing lanes share the socket, call before
+				// sending anything
+				void SetOutgoingScheduling(const lane_config &config)
+				{
+					m_qMessagesOut.Configure(config);
+				}
+
+				// Number of messages waiting to be sent in a priority lane
+				size_t GetOutgoingDepth(priority prio) const
+				{
+					return (m_qMessagesOut.depth(prio));
+				}
+
+				// When the remote last sent us anything, for idle timeouts. Safe to
+				// call from any thread
+				std::chrono::steady_clock::time_point GetLastActivity() const
+				{
+					return (std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(m_nLastActivity.load(std::memory_order_relaxed))));
+				}
+
+				// True while the rate limit is holding off reads. Nothing is read
+				// then, however busy the remote is, so it doesn't count as idle.
+				// Safe to call from any thread
+				bool IsThrottled() const
+				{
+					return (m_bThrottled.load(std::memory_order_relaxed));
+				}
+
+				// True while backpressure has parked the connection until the
+				// owner drains its queue. As with throttling, nothing is read in
+				// the meantime. Safe to call from any thread
+				bool IsParked() const
+				{
+					return (m_bParked.load(std::memory_order_relaxed));
+				}
+
 			private:
-				// ASYNC - Prime context ready to read a message header
-				void ReadHeader()
+				// ASYNC - Prime context to read whatever the socket has for us. Reads
+				// go into a per-connection buffer, as much as fits, and every
+				// complete frame in there is parsed out before reading again - so
+				// a burst of small messages costs one read rather than two each
+				void ReadMessages()
 				{
-					boost::asio::async_read(m_socket, boost::asio::buffer(&m_msgTemporaryIn.header, sizeof(message_header<T>)),
-						[this](std::error_code ec, std::size_t length)
+					// Slide any partial frame down to the start to make room
+					if (m_nReadStart > 0)
+					{
+						std::memmove(m_vReadBuffer.data(), m_vReadBuffer.data() + m_nReadStart, m_nReadEnd - m_nReadStart);
+						m_nReadEnd -= m_nReadStart;
+						m_nReadStart = 0;
+					}
+
+					m_socket.async_read_some(boost::asio::buffer(m_vReadBuffer.data() + m_nReadEnd, m_vReadBuffer.size() - m_nReadEnd),
+						[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 						{
 							if (!ec)
 							{
-								if (m_msgTemporaryIn.header.size > 0)
-								{
-									m_msgTemporaryIn.body.resize(m_msgTemporaryIn.header.size);
-									ReadBody();
-								}
-								else
+								m_nReadEnd += length;
+								if (m_pMetrics)
 								{
-									AddToIncomingMessageQueue();
+									m_pMetrics->pReads->inc();
+									m_pMetrics->pBytesRead->inc(length);
 								}
+								Touch();
+								RearmQuickAck();
+								ParseMessages();
 							}
 							else
 							{
-								std::cout << "[" << id << "] Read Header Fail.\n";
+								OLC_NET_LOG_INFO("[{}] Read Fail.", id);
+								if (m_pMetrics) m_pMetrics->pErrors->inc();
 								m_socket.close();
 							}
 						});
 				}
 
-				// ASYNC - Prime context ready to read a message body
-				void ReadBody()
+				// Queues every complete frame in the read buffer, then goes back to
+				// reading. A partial frame stays put for the next read to finish
+				void ParseMessages()
+				{
+					for (;;)
+					{
+						if (Throttle())
+							return;
+
+						const uint8_t *p = m_vReadBuffer.data() + m_nReadStart;
+						size_t nAvailable = m_nReadEnd - m_nReadStart;
+
+						if (nAvailable < wire_header<T>::nPrefixSize)
+							break;
+
+						size_t nMore = 0;
+						if (!wire_header<T>::remaining(p, nMore))
+						{
+							OLC_NET_LOG_WARN("[{}] Bad Header.", id);
+							if (m_pMetrics) m_pMetrics->pErrors->inc();
+							m_socket.close();
+							return;
+						}
+
+						size_t nHeader = wire_header<T>::nPrefixSize + nMore;
+						if (nAvailable < nHeader)
+							break;
+
+						message_header<T> header;
+						if (!wire_header<T>::decode(p, nHeader, header))
+						{
+							OLC_NET_LOG_WARN("[{}] Bad Header.", id);
+							if (m_pMetrics) m_pMetrics->pErrors->inc();
+							m_socket.close();
+							return;
+						}
+
+						size_t nFrame = nHeader + header.size;
+						if (nFrame > m_vReadBuffer.size())
+						{
+							// Body will never fit in the buffer, so take what has
+							// arrived and read the rest straight into the message
+							m_msgTemporaryIn.header = header;
+							m_msgTemporaryIn.body.resize(header.size);
+							size_t nHave = nAvailable - nHeader;
+							std::memcpy(m_msgTemporaryIn.body.data(), p + nHeader, nHave);
+							m_nReadStart = m_nReadEnd = 0;
+							ReadBody(nHave);
+							return;
+						}
+
+						if (nAvailable < nFrame)
+							break;
+
+						// Complete frame, copy the body out once into its message
+						m_msgTemporaryIn.header = header;
+						m_msgTemporaryIn.body.resize(header.size);
+						std::memcpy(m_msgTemporaryIn.body.data(), p + nHeader, header.size);
+						m_nReadStart += nFrame;
+
+						if (!AddToIncomingMessageQueue())
+							return;
+					}
+
+					ReadMessages();
+				}
+
+				// ASYNC - Prime context to read the rest of an oversized body, from
+				// nOffset onwards, directly into m_msgTemporaryIn
+				void ReadBody(size_t nOffset)
 				{
-					boost::asio::async_read(m_socket, boost::asio::buffer(m_msgTemporaryIn.body.data(), m_msgTemporaryIn.body.size()),
-						[this](std::error_code ec, std::size_t length)
+					boost::asio::async_read(m_socket, boost::asio::buffer(m_msgTemporaryIn.body.data() + nOffset, m_msgTemporaryIn.body.size() - nOffset),
+						[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 						{
 							if (!ec)
 							{
-								AddToIncomingMessageQueue();
+								if (m_pMetrics)
+								{
+									m_pMetrics->pReads->inc();
+									m_pMetrics->pBytesRead->inc(length);
+								}
+								Touch();
+								if (AddToIncomingMessageQueue())
+									ReadMessages();
 							}
 							else
 							{
-								// As above!
-								std::cout << "[" << id << "] Read body Fail.\n";
+								OLC_NET_LOG_INFO("[{}] Read body Fail.", id);
+								if (m_pMetrics) m_pMetrics->pErrors->inc();
 								m_socket.close();
 							}
 						});
 				}
 
-				// ASYNC - Prime context to write a message header
-				void WriteHeader()
+				// ASYNC - Prime context to write as many queued messages as fit in
+				// one go. Each message's header and body become entries in a single
+				// buffer sequence, so a burst of small messages goes out in one
+				// gathered write rather than two writes apiece
+				void WriteMessages()
 				{
-					boost::asio::async_write(m_socket, boost::asio::buffer(&m_qMessagesOut.front().header, sizeof(message_header<T>)),
-						[this](std::error_code ec, std::size_t length)
+					m_bWriting = true;
+
+					// Take messages off the queue first - an inline body lives in
+					// the message itself, so its address is only fixed once the
+					// batch has stopped growing
+					size_t nBytes = 0, nStaging = 0, nBuffers = 1;
+					while (!m_qMessagesOut.empty() && nBuffers + 2 <= nMaxWriteBuffers
+						&& (m_vWriting.empty() || nBytes < nMaxWriteBytes))
+					{
+						m_vWriting.push_back(m_qMessagesOut.pop_front());
+						const auto &msg = m_vWriting.back();
+						nBytes += msg.body.size() + wire_header<T>::nMaxSize;
+						nStaging += wire_header<T>::nMaxSize;
+						m_nQueuedBytes -= msg.size();
+
+						if (msg.body.size() <= nMaxCopyBody)
+							nStaging += msg.body.size();
+						else
+							nBuffers += 2;
+					}
+
+					// Headers, and bodies small enough to copy, are laid out back
+					// to back in m_vStaging so a run of small messages is one
+					// buffer. Bigger bodies are sent from where they are. The body
+					// length always comes from the body itself, so a stale
+					// header.size can't desync the stream
+					if (m_vStaging.size() < nStaging)
+						m_vStaging.resize(nStaging);
+
+					m_vWriteBuffers.clear();
+					uint8_t *pSegment = m_vStaging.data();
+					uint8_t *p = pSegment;
+					for (const auto &msg : m_vWriting)
+					{
+						p += wire_header<T>::encode(msg.header, uint32_t(msg.body.size()), p);
+
+						if (msg.body.size() <= nMaxCopyBody)
 						{
-							if (!ec)
-							{
-								if (m_qMessagesOut.front().body.size() > 0)
-								{
-									WriteBody();
-								}
-								else
+							if (!msg.body.empty())
+								std::memcpy(p, msg.body.data(), msg.body.size());
+							p += msg.body.size();
+						}
+						else
+						{
+							m_vWriteBuffers.push_back(boost::asio::buffer(pSegment, p - pSegment));
+							m_vWriteBuffers.push_back(boost::asio::buffer(msg.body.data(), msg.body.size()));
+							pSegment = p;
+						}
+					}
+
+					if (p > pSegment)
+						m_vWriteBuffers.push_back(boost::asio::buffer(pSegment, p - pSegment));
+
+					WriteBuffers();
+				}
+
+				// Writes whatever is queued, unless corking says to hold on to it,
+				// in which case the cork timer is started if it isn't already
+				void StartWriting()
+				{
+					if (m_bWriting)
+						return;
+
+					if (m_qMessagesOut.empty())
+					{
+						m_bFlushPending = false;
+						return;
+					}
+
+					if (m_cork.bEnabled && !m_bFlushPending && m_nQueuedBytes < m_cork.nFlushBytes
+						&& m_qMessagesOut.depth(priority::control) == 0)
+					{
+						if (!m_bCorkArmed)
+						{
+							m_bCorkArmed = true;
+							m_timerCork.expires_after(m_cork.tFlushDelay);
+							m_timerCork.async_wait(
+								[this, self = this->shared_from_this()](std::error_code ec)
 								{
-									m_qMessagesOut.pop_front();
+									// A cancelled wait has already been dealt with
+									if (ec)
+										return;
 
-									if (!m_qMessagesOut.empty())
+									m_bCorkArmed = false;
+									if (m_socket.is_open())
 									{
-										WriteHeader();
+										m_bFlushPending = true;
+										StartWriting();
 									}
-								}
-							}
-							else
-							{
-								std::cout << "[" << id << "] Write Header Fail.\n";
-								m_socket.close();
-							}
-						});
+								});
+						}
+						return;
+					}
+
+					if (m_bCorkArmed)
+					{
+						m_bCorkArmed = false;
+						m_timerCork.cancel();
+					}
 
+					WriteMessages();
 				}
 
-				// ASYNC - Prime context to write a message body
-				void WriteBody()
+				// ASYNC - Prime context to write what is left of the batch. This
+				// goes through async_write_some rather than async_write, which
+				// would only hand 16 buffers to each sendmsg
+				void WriteBuffers()
 				{
-					boost::asio::async_write(m_socket, boost::asio::buffer(m_qMessagesOut.front().body.data(), m_msgTemporaryIn.body.size()),
-						[this](std::error_code ec, std::size_t length)
+					m_socket.async_write_some(m_vWriteBuffers,
+						[this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
 						{
 							if (!ec)
 							{
-								m_qMessagesOut.pop_front();
+								ConsumeWriteBuffers(length);
+								if (m_pMetrics)
+								{
+									m_pMetrics->pWrites->inc();
+									m_pMetrics->pBytesWritten->inc(length);
+								}
+								if (!m_vWriteBuffers.empty())
+								{
+									// Socket took part of the batch, send the rest
+									WriteBuffers();
+									return;
+								}
 
-								if (!m_qMessagesOut.empty())
+								// Everything in the batch is out, bodies go back to the pool
+								if (m_pMetrics)
 								{
-									WriteHeader();
+									m_pMetrics->pMessagesOut->inc(m_vWriting.size());
+									m_pMetrics->pWriteBatch->record(m_vWriting.size());
 								}
+								m_vWriting.clear();
+
+								m_bWriting = false;
+								StartWriting();
 							}
 							else
 							{
-								std::cout << "[" << id << "] Write Body Fail.\n";
+								OLC_NET_LOG_INFO("[{}] Write Fail.", id);
+								if (m_pMetrics) m_pMetrics->pErrors->inc();
 								m_socket.close();
 							}
 						});
 				}
 
-				void AddToIncomingMessageQueue()
+				// Drops nBytes from the front of the pending buffer sequence
+				void ConsumeWriteBuffers(size_t nBytes)
 				{
+					size_t nDone = 0;
+					while (nDone < m_vWriteBuffers.size() && nBytes >= m_vWriteBuffers[nDone].size())
+					{
+						nBytes -= m_vWriteBuffers[nDone].size();
+						nDone++;
+					}
+
+					if (nDone < m_vWriteBuffers.size())
+						m_vWriteBuffers[nDone] += nBytes;
+
+					m_vWriteBuffers.erase(m_vWriteBuffers.begin(), m_vWriteBuffers.begin() + nDone);
+				}
+
+				enum class ping_kind : uint8_t
+				{
+					ping,
+					pong
+				};
+
+				// Io thread only
+				void QueueOutgoing(message<T> &&msg, priority prio)
+				{
+					m_nQueuedBytes += msg.size();
+					m_qMessagesOut.push_back(std::move(msg), prio);
+					StartWriting();
+				}
+
+				// Answers a ping by sending its stamp straight back, or times a pong
+				// against the stamp we sent
+				void HandlePing()
+				{
+					uint64_t nStamp = 0;
+					uint8_t nKind = 0;
+					if (m_msgTemporaryIn.body.size() != sizeof(nStamp) + sizeof(nKind))
+						return;
+					m_msgTemporaryIn >> nKind >> nStamp;
+
+					if (ping_kind(nKind) == ping_kind::ping)
+					{
+						message<T> msg;
+						msg.header.id = ping_id<T>();
+						msg << nStamp << uint8_t(ping_kind::pong);
+						QueueOutgoing(std::move(msg), priority::control);
+					}
+					else if (ping_kind(nKind) == ping_kind::pong)
+					{
+						auto tpSent = std::chrono::steady_clock::time_point(std::chrono::steady_clock::duration(nStamp));
+						m_rtt.AddSample(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - tpSent));
+					}
+				}
+
+				// True if a rate limit bucket is in debt, in which case parsing
+				// and reading stop and a timer picks them up again once it
+				// has refilled
+				bool Throttle()
+				{
+					if (m_bThrottled.load(std::memory_order_relaxed))
+						return (true);
+					if (!m_bucketMessages.enabled() && !m_bucketBytes.enabled())
+						return (false);
+
+					auto tpNow = std::chrono::steady_clock::now();
+					auto tWait = std::max(m_bucketMessages.enabled() ? m_bucketMessages.wait(tpNow) : std::chrono::nanoseconds(0),
+						m_bucketBytes.enabled() ? m_bucketBytes.wait(tpNow) : std::chrono::nanoseconds(0));
+					if (tWait.count() == 0)
+						return (false);
+
+					m_bThrottled.store(true, std::memory_order_relaxed);
+					m_nThrottles.fetch_add(1, std::memory_order_relaxed);
+					m_nThrottledMicros.fetch_add(std::chrono::duration_cast<std::chrono::microseconds>(tWait).count(), std::memory_order_relaxed);
+
+					m_timerThrottle.expires_after(tWait);
+					m_timerThrottle.async_wait(
+						[this, self = this->shared_from_this()](std::error_code ec)
+						{
+							// Taking in what was held back is the remote's doing too
+							Touch();
+							m_bThrottled.store(false, std::memory_order_relaxed);
+							if (!ec && m_socket.is_open())
+								ParseMessages();
+						});
+					return (true);
+				}
+
+				// Queues m_msgTemporaryIn. Returns false if backpressure parked the
+				// connection, in which case reading stops until ResumeReading
+				bool AddToIncomingMessageQueue()
+				{
+					// Pings are the framework's own business
+					if (m_msgTemporaryIn.header.id == ping_id<T>())
+					{
+						HandlePing();
+						return (true);
+					}
+
+					if (m_pMetrics) m_pMetrics->pMessagesIn->inc();
+
+					m_bucketMessages.consume(1.0);
+					m_bucketBytes.consume(double(m_msgTemporaryIn.size()));
+
+					// Account for the message before it becomes visible to the
+					// consumer, so the consumer never takes off more than was put on
+					bool bOverfull = m_pBackpressure && m_pBackpressure->OnEnqueue(m_msgTemporaryIn.size());
+
+					// The body is handed over rather than copied, the next message
+					// gets a fresh one
 					if (m_nOwnerType == owner::server)
-						m_qMessagesIn.push_back({ this->shared_from_this(), m_msgTemporaryIn });
+						m_qMessagesIn.push_back({ this->shared_from_this(), std::move(m_msgTemporaryIn) });
 					else
-						m_qMessagesIn.push_back({ nullptr, m_msgTemporaryIn });
+						m_qMessagesIn.push_back({ nullptr, std::move(m_msgTemporaryIn) });
+
+					// If the queue is too full, stop reading and let TCP push back on
+					// the remote until the owner drains it
+					if (bOverfull)
+					{
+						// Marked first, ResumeReading may come as soon as it's parked
+						m_bParked.store(true, std::memory_order_relaxed);
+						if (m_pBackpressure->Pause(this->shared_from_this()))
+							return (false);
+						m_bParked.store(false, std::memory_order_relaxed);
+					}
 
-					ReadHeader();
+					return (true);
+				}
+
+				void ApplySocketOptions()
+				{
+					if (std::error_code ec = apply_socket_options(m_socket, m_sockOptions))
+						OLC_NET_LOG_WARN("[{}] Socket Options: {}", id, ec);
+				}
+
+				// Linux drops out of quick ack mode by itself, so ask again
+				void RearmQuickAck()
+				{
+#ifdef TCP_QUICKACK
+					if (m_sockOptions.bQuickAck)
+					{
+						boost::system::error_code ec;
+						m_socket.set_option(boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_QUICKACK>(true), ec);
+					}
+#endif
+				}
+
+				// Notes that the remote is still alive
+				void Touch()
+				{
+					m_nLastActivity.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
 				}
 
 			protected:
@@ -188,18 +696,77 @@ namespace olc
 				boost::asio::io_context &m_asioContext;
 
 				// This queue holds all messages to be sent to the remote side
-				// of this connection
-				ocl::net::tsqueue<message<T>> m_qMessagesOut;
+				// of this connection, one lane per priority. Send posts onto the
+				// io context, so the lanes are only ever touched from the io thread
+				// and need no lock
+				outbound_lanes<T> m_qMessagesOut;
 
 				// This queue holds all messages that have been received from
 				// the remote side of this connection. Note it is a reference
 				// as the "owner" of this connection is expected to provide a queue
-				ocl::net::tsqueue<owned_message<T>> &m_qMessagesIn;
+				ocl::net::queue_sink<owned_message<T>> &m_qMessagesIn;
 				message<T> m_msgTemporaryIn;
 
+				// Bytes read from the socket that haven't been parsed into messages
+				// yet live between m_nReadStart and m_nReadEnd
+				static constexpr size_t nReadBufferSize = 16 * 1024;
+				std::vector<uint8_t> m_vReadBuffer = std::vector<uint8_t>(nReadBufferSize);
+				size_t m_nReadStart = 0;
+				size_t m_nReadEnd = 0;
+
+				// A gathered write covers, past the first message, at most this many
+				// bytes, and stays inside the 64 iovec limit asio puts on one
+				// sendmsg. Bodies up to nMaxCopyBody are copied in beside their
+				// header rather than taking iovecs of their own
+				static constexpr size_t nMaxWriteBuffers = 64;
+				static constexpr size_t nMaxWriteBytes = 256 * 1024;
+				static constexpr size_t nMaxCopyBody = 256;
+
+				// The batch of messages being written, their encoded headers and
+				// small bodies, and the buffer sequence handed to asio. All are
+				// reused between writes
+				std::vector<message<T>> m_vWriting;
+				std::vector<uint8_t> m_vStaging;
+				std::vector<boost::asio::const_buffer> m_vWriteBuffers;
+				bool m_bWriting = false;
+
+				// Corking, see SetCork. m_nQueuedBytes is what m_qMessagesOut holds
+				cork_config m_cork;
+				size_t m_nQueuedBytes = 0;
+				boost::asio::steady_timer m_timerCork;
+				bool m_bCorkArmed = false;
+				bool m_bFlushPending = false;
+
+				// Depth tracking for m_qMessagesIn, provided by the owner if it
+				// wants reads to back off when the queue fills up
+				backpressure<T> *m_pBackpressure = nullptr;
+				std::atomic<bool> m_bParked{ false };
+
+				// steady_clock ticks at the last successful read, starting from
+				// when the connection was made
+				std::atomic<std::chrono::steady_clock::rep> m_nLastActivity{ std::chrono::steady_clock::now().time_since_epoch().count() };
+
+				// Round trips of our pings
+				rtt_tracker m_rtt;
+
+				// See SetSocketOptions
+				socket_options m_sockOptions;
+
+				// See SetMetrics
+				const connection_metrics *m_pMetrics = nullptr;
+
+				// Inbound rate limits, see SetRateLimit. Only the io thread
+				// touches the buckets
+				token_bucket m_bucketMessages;
+				token_bucket m_bucketBytes;
+				boost::asio::steady_timer m_timerThrottle;
+				std::atomic<bool> m_bThrottled{ false };
+				std::atomic<uint64_t> m_nThrottles{ 0 };
+				std::atomic<uint64_t> m_nThrottledMicros{ 0 };
+
 				// The "owner" decides how some of the connection behaves
 				owner m_nOwnerType = owner::server;
-				uint32_t id = 0;
+				uint64_t id = 0;
 		};
 	}
 }
\ No newline at end of file
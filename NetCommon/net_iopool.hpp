@@ -0,0 +1,133 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// How a new connection picks its io_context from the pool
+		enum class io_assignment
+		{
+			round_robin,
+			least_loaded,
+		};
+
+		// A set of io_contexts, each run by a thread of its own. A connection lives
+		// on exactly one of them for its whole life, so its handlers never run
+		// concurrently and need no strand or locking - the pool just spreads
+		// connections across cores
+		class io_context_pool
+		{
+			public:
+				io_context_pool() = default;
+				io_context_pool(const io_context_pool&) = delete;
+
+				~io_context_pool()
+				{
+					Stop();
+				}
+
+			public:
+				void Start(size_t nThreads)
+				{
+					m_vLoad = std::vector<std::atomic<size_t>>(nThreads);
+
+					for (size_t i = 0; i < nThreads; i++)
+					{
+						// Each context is only ever run by one thread, so tell asio
+						// it can skip some internal locking
+						m_vContexts.push_back(std::make_unique<boost::asio::io_context>(1));
+						m_vWork.push_back(boost::asio::make_work_guard(*m_vContexts.back()));
+					}
+
+					for (auto &context : m_vContexts)
+						m_vThreads.emplace_back([ctx = context.get()]() { ctx->run(); });
+				}
+
+				void Stop()
+				{
+					m_vWork.clear();
+
+					for (auto &context : m_vContexts)
+						context->stop();
+
+					for (auto &thread : m_vThreads)
+						if (thread.joinable()) thread.join();
+
+					m_vThreads.clear();
+				}
+
+				size_t size() const
+				{
+					return (m_vContexts.size());
+				}
+
+				// Which context a new connection should go to, without taking it.
+				// Only call from one thread (the acceptor's), with Acquire
+				size_t Next(io_assignment mode) const
+				{
+					size_t nChosen = 0;
+
+					if (mode == io_assignment::least_loaded)
+					{
+						for (size_t i = 1; i < m_vContexts.size(); i++)
+							if (m_vLoad[i].load(std::memory_order_relaxed) < m_vLoad[nChosen].load(std::memory_order_relaxed))
+								nChosen = i;
+					}
+					else
+					{
+						nChosen = m_nNext % m_vContexts.size();
+					}
+
+					return (nChosen);
+				}
+
+				// Counts a new connection against the context Next chose, and moves
+				// the round robin on past it
+				boost::asio::io_context &Acquire(size_t i)
+				{
+					m_vLoad[i].fetch_add(1, std::memory_order_relaxed);
+					m_nNext = i + 1;
+					return (*m_vContexts[i]);
+				}
+
+				// Counts a new connection against a particular context
+				boost::asio::io_context &Acquire(boost::asio::io_context &context)
+				{
+					for (size_t i = 0; i < m_vContexts.size(); i++)
+						if (m_vContexts[i].get() == &context)
+							m_vLoad[i].fetch_add(1, std::memory_order_relaxed);
+					return (context);
+				}
+
+				boost::asio::io_context &Context(size_t i)
+				{
+					return (*m_vContexts[i]);
+				}
+
+				// A connection on this context has gone away
+				void Release(boost::asio::io_context &context)
+				{
+					for (size_t i = 0; i < m_vContexts.size(); i++)
+						if (m_vContexts[i].get() == &context)
+							m_vLoad[i].fetch_sub(1, std::memory_order_relaxed);
+				}
+
+				// Number of connections on each context
+				std::vector<size_t> GetLoads() const
+				{
+					std::vector<size_t> vLoads;
+					for (auto &load : m_vLoad)
+						vLoads.push_back(load.load(std::memory_order_relaxed));
+					return (vLoads);
+				}
+
+			private:
+				std::vector<std::unique_ptr<boost::asio::io_context>> m_vContexts;
+				std::vector<boost::asio::executor_work_guard<boost::asio::io_context::executor_type>> m_vWork;
+				std::vector<std::thread> m_vThreads;
+				std::vector<std::atomic<size_t>> m_vLoad;
+				size_t m_nNext = 0;
+		};
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_tsqueue.hpp"
+#include "net_message.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// Priority class of an outgoing message. Each class has its own lane in
+		// the outgoing queue, so a ping doesn't wait behind bulk data
+		enum class priority : uint8_t
+		{
+			control,
+			high,
+			normal,
+			bulk,
+		};
+
+		static constexpr size_t nPriorityLanes = 4;
+
+		// How the writer picks the next lane to send from. Strict always empties
+		// the most important non-empty lane first; otherwise lanes take turns,
+		// each sending up to its weight in messages per round
+		struct lane_config
+		{
+			bool bStrict = true;
+			std::array<uint32_t, nPriorityLanes> nWeights{ 8, 4, 2, 1 };
+		};
+
+		// Outgoing queue split into priority lanes. Only the io thread pushes and
+		// pops; the per-lane depths may be read from anywhere
+		template <typename T>
+		class outbound_lanes
+		{
+			public:
+				void Configure(const lane_config &config)
+				{
+					m_config = config;
+					m_nCredit = m_config.nWeights[m_nTurn];
+				}
+
+				// Adds a message to the back of its lane
+				void push_back(message<T> &&msg, priority prio = priority::normal)
+				{
+					size_t nLane = size_t(prio);
+					m_vLanes[nLane].push_back(std::move(msg));
+					m_nDepth[nLane].fetch_add(1, std::memory_order_relaxed);
+					m_nCount++;
+				}
+
+				// Returns true if every lane is empty
+				bool empty() const
+				{
+					return (m_nCount == 0);
+				}
+
+				// Returns the message the writer should send next. The choice sticks
+				// until it is popped, so a message is never interleaved with another
+				const message<T>& front()
+				{
+					if (m_nSelected == nNoLane)
+						m_nSelected = SelectLane();
+					return (m_vLanes[m_nSelected].front());
+				}
+
+				// Removes and returns the message the writer should send next (the
+				// one front returned, if it was called)
+				message<T> pop_front()
+				{
+					if (m_nSelected == nNoLane)
+						m_nSelected = SelectLane();
+					message<T> msg = m_vLanes[m_nSelected].pop_front();
+					m_nDepth[m_nSelected].fetch_sub(1, std::memory_order_relaxed);
+					m_nSelected = nNoLane;
+					m_nCount--;
+					return (msg);
+				}
+
+				// Number of messages waiting in a lane
+				size_t depth(priority prio) const
+				{
+					return (m_nDepth[size_t(prio)].load(std::memory_order_relaxed));
+				}
+
+			private:
+				size_t SelectLane()
+				{
+					if (m_config.bStrict)
+					{
+						for (size_t i = 0; i < nPriorityLanes; i++)
+							if (!m_vLanes[i].empty())
+								return (i);
+						return (nNoLane);
+					}
+
+					// Weighted round robin - stay on the current lane while it has
+					// credit and something to send, otherwise move on and refill
+					for (size_t n = 0; n <= nPriorityLanes; n++)
+					{
+						if (m_nCredit > 0 && !m_vLanes[m_nTurn].empty())
+						{
+							m_nCredit--;
+							return (m_nTurn);
+						}
+
+						m_nTurn = (m_nTurn + 1) % nPriorityLanes;
+						m_nCredit = std::max<uint32_t>(m_config.nWeights[m_nTurn], 1);
+					}
+					return (nNoLane);
+				}
+
+				static constexpr size_t nNoLane = size_t(-1);
+
+			private:
+				std::array<ocl::net::tsqueue<message<T>, ocl::net::null_lock>, nPriorityLanes> m_vLanes;
+				std::array<std::atomic<size_t>, nPriorityLanes> m_nDepth{};
+
+				lane_config m_config;
+				size_t		m_nCount = 0;
+				size_t		m_nSelected = nNoLane;
+				size_t		m_nTurn = 0;
+				uint32_t	m_nCredit = 8;
+		};
+	}
+}
@@ -0,0 +1,413 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_tsqueue.hpp"
+
+// Log calls below this level are compiled out altogether, arguments and all.
+// 0 trace, 1 debug, 2 info, 3 warn, 4 error
+#ifndef OLC_NET_LOG_LEVEL
+#define OLC_NET_LOG_LEVEL 0
+#endif
+
+#define OLC_NET_LOG(level, ...) \
+	do { if constexpr (olc::net::log_enabled(olc::net::log_level::level)) olc::net::logger::Get().Write(olc::net::log_level::level, __VA_ARGS__); } while (0)
+
+#define OLC_NET_LOG_TRACE(...) OLC_NET_LOG(trace, __VA_ARGS__)
+#define OLC_NET_LOG_DEBUG(...) OLC_NET_LOG(debug, __VA_ARGS__)
+#define OLC_NET_LOG_INFO(...) OLC_NET_LOG(info, __VA_ARGS__)
+#define OLC_NET_LOG_WARN(...) OLC_NET_LOG(warn, __VA_ARGS__)
+#define OLC_NET_LOG_ERROR(...) OLC_NET_LOG(error, __VA_ARGS__)
+
+namespace olc
+{
+	namespace net
+	{
+		enum class log_level : uint8_t
+		{
+			trace,
+			debug,
+			info,
+			warn,
+			error,
+			off
+		};
+
+		// Whether calls at a level are compiled in, see OLC_NET_LOG_LEVEL. The
+		// minimum comes in as a parameter so the compiler doesn't warn that the
+		// comparison is always true at the default of 0
+		constexpr bool log_enabled(log_level level, int nMinimum = OLC_NET_LOG_LEVEL)
+		{
+			return (int(level) >= nMinimum);
+		}
+
+		// One log call, as the calling thread left it: the format string, which
+		// must be a literal as only its address is kept, and the arguments in
+		// binary. Turning them into text is left to the flusher thread. Strings
+		// are copied, and cut short if the record runs out of room
+		struct log_record
+		{
+			static constexpr size_t nMaxArgBytes = 192;
+
+			enum class arg_type : uint8_t
+			{
+				int64,
+				uint64,
+				float64,
+				boolean,
+				string,
+				error_code
+			};
+
+			template <typename... Args>
+			log_record(log_level level, const char *format, const Args&... args)
+				: level(level), pFormat(format), tp(std::chrono::steady_clock::now())
+			{
+				(Encode(args), ...);
+			}
+
+			log_level level;
+			const char *pFormat;
+			std::chrono::steady_clock::time_point tp;
+			uint16_t nBytes = 0;
+			std::array<uint8_t, nMaxArgBytes> vArgs;
+
+			// Appends the record as text, one {} in the format per argument
+			void Format(std::string &sOut) const
+			{
+				size_t nOffset = 0;
+				for (const char *p = pFormat; *p; p++)
+				{
+					if (p[0] == '{' && p[1] == '}')
+					{
+						FormatArg(sOut, nOffset);
+						p++;
+					}
+					else
+					{
+						sOut += *p;
+					}
+				}
+				sOut += '\n';
+			}
+
+		private:
+			bool Put(arg_type type, const void *pData, size_t nSize)
+			{
+				if (nBytes + 1 + nSize > nMaxArgBytes)
+					return (false);
+				vArgs[nBytes] = uint8_t(type);
+				std::memcpy(vArgs.data() + nBytes + 1, pData, nSize);
+				nBytes += uint16_t(1 + nSize);
+				return (true);
+			}
+
+			void PutString(const char *pData, size_t nSize)
+			{
+				if (nBytes + size_t(3) > nMaxArgBytes)
+					return;
+				nSize = std::min<size_t>(nSize, nMaxArgBytes - nBytes - 3);
+				uint16_t nLength = uint16_t(nSize);
+				vArgs[nBytes] = uint8_t(arg_type::string);
+				std::memcpy(vArgs.data() + nBytes + 1, &nLength, sizeof(nLength));
+				std::memcpy(vArgs.data() + nBytes + 3, pData, nSize);
+				nBytes += uint16_t(3 + nSize);
+			}
+
+			template <typename Arg>
+			void Encode(const Arg &arg)
+			{
+				if constexpr (std::is_same_v<Arg, bool>)
+				{
+					Put(arg_type::boolean, &arg, sizeof(arg));
+				}
+				else if constexpr (std::is_enum_v<Arg>)
+				{
+					Encode(std::underlying_type_t<Arg>(arg));
+				}
+				else if constexpr (std::is_integral_v<Arg> && std::is_signed_v<Arg>)
+				{
+					int64_t n = arg;
+					Put(arg_type::int64, &n, sizeof(n));
+				}
+				else if constexpr (std::is_integral_v<Arg>)
+				{
+					uint64_t n = arg;
+					Put(arg_type::uint64, &n, sizeof(n));
+				}
+				else if constexpr (std::is_floating_point_v<Arg>)
+				{
+					double d = arg;
+					Put(arg_type::float64, &d, sizeof(d));
+				}
+				else if constexpr (std::is_convertible_v<const Arg &, std::string_view>)
+				{
+					std::string_view s = arg;
+					PutString(s.data(), s.size());
+				}
+				else if constexpr (std::is_convertible_v<const Arg &, std::error_code>)
+				{
+					// Categories live for the whole program, so the message can
+					// be looked up later
+					std::error_code ec = arg;
+					struct { int nValue; const std::error_category *pCategory; } code{ ec.value(), &ec.category() };
+					Put(arg_type::error_code, &code, sizeof(code));
+				}
+				else
+				{
+					static_assert(std::is_arithmetic_v<Arg>, "log arguments must be numbers, strings or error codes");
+				}
+			}
+
+			void FormatArg(std::string &sOut, size_t &nOffset) const
+			{
+				if (nOffset >= nBytes)
+					return;
+
+				const uint8_t *p = vArgs.data() + nOffset + 1;
+				switch (arg_type(vArgs[nOffset]))
+				{
+				case arg_type::int64:
+				{
+					int64_t n;
+					std::memcpy(&n, p, sizeof(n));
+					sOut += std::to_string(n);
+					nOffset += 1 + sizeof(n);
+					break;
+				}
+				case arg_type::uint64:
+				{
+					uint64_t n;
+					std::memcpy(&n, p, sizeof(n));
+					sOut += std::to_string(n);
+					nOffset += 1 + sizeof(n);
+					break;
+				}
+				case arg_type::float64:
+				{
+					double d;
+					std::memcpy(&d, p, sizeof(d));
+					std::ostringstream ss;
+					ss << d;
+					sOut += ss.str();
+					nOffset += 1 + sizeof(d);
+					break;
+				}
+				case arg_type::boolean:
+				{
+					sOut += *p ? "true" : "false";
+					nOffset += 1 + sizeof(bool);
+					break;
+				}
+				case arg_type::string:
+				{
+					uint16_t nLength;
+					std::memcpy(&nLength, p, sizeof(nLength));
+					sOut.append(reinterpret_cast<const char *>(p + sizeof(nLength)), nLength);
+					nOffset += 1 + sizeof(nLength) + nLength;
+					break;
+				}
+				case arg_type::error_code:
+				{
+					struct { int nValue; const std::error_category *pCategory; } code;
+					std::memcpy(&code, p, sizeof(code));
+					sOut += code.pCategory->message(code.nValue);
+					nOffset += 1 + sizeof(code);
+					break;
+				}
+				}
+			}
+		};
+
+		struct log_stats
+		{
+			uint64_t nWritten = 0;
+
+			// Records lost because a thread's ring was full
+			uint64_t nDropped = 0;
+		};
+
+		// Asynchronous logger. Each thread that logs gets its own SPSC ring, so a
+		// log call is a timestamp, a few memcpys and a release store - no lock,
+		// no formatting and no syscall. A background thread drains the rings,
+		// formats the records in time order and writes them out in one go. If a
+		// ring fills, records are dropped and counted rather than stalling the
+		// thread that made them
+		class logger
+		{
+			public:
+				static constexpr size_t nRingSize = 512;
+				using ring = ocl::net::tsqueue<log_record, ocl::net::spsc_lock<nRingSize>>;
+
+			public:
+				static logger &Get()
+				{
+					static logger instance;
+					return (instance);
+				}
+
+				~logger()
+				{
+					{
+						std::scoped_lock lock(m_muxRings);
+						m_bStop = true;
+					}
+					m_cvFlush.notify_one();
+					if (m_threadFlush.joinable())
+						m_threadFlush.join();
+					Flush();
+				}
+
+				// Records below this level are skipped at run time; see also
+				// OLC_NET_LOG_LEVEL to compile them out
+				void SetLevel(log_level level)
+				{
+					m_nLevel.store(uint8_t(level), std::memory_order_relaxed);
+				}
+
+				log_level GetLevel() const
+				{
+					return (log_level(m_nLevel.load(std::memory_order_relaxed)));
+				}
+
+				// Where trace, debug and info go, std::cout unless told otherwise.
+				// The stream must outlive the logger
+				void SetOutput(std::ostream &out)
+				{
+					std::scoped_lock lock(m_muxOutput);
+					m_pOutput = &out;
+				}
+
+				// Where warnings and errors go, std::cerr unless told otherwise.
+				// The stream must outlive the logger
+				void SetErrorOutput(std::ostream &out)
+				{
+					std::scoped_lock lock(m_muxOutput);
+					m_pErrorOutput = &out;
+				}
+
+				// How often the background thread drains the rings
+				void SetFlushInterval(std::chrono::milliseconds tInterval)
+				{
+					m_tFlushInterval.store(tInterval.count(), std::memory_order_relaxed);
+				}
+
+				template <typename... Args>
+				void Write(log_level level, const char *format, const Args&... args)
+				{
+					if (uint8_t(level) < m_nLevel.load(std::memory_order_relaxed))
+						return;
+
+					ring &r = LocalRing();
+					if (r.try_emplace_back(level, format, args...))
+						m_nWritten.fetch_add(1, std::memory_order_relaxed);
+					else
+						m_nDropped.fetch_add(1, std::memory_order_relaxed);
+
+					// Don't wait out the interval if this thread is filling up fast
+					if (r.count() == nRingSize / 2)
+						m_cvFlush.notify_one();
+				}
+
+				// Writes out everything logged so far, from the calling thread
+				void Flush()
+				{
+					std::scoped_lock lock(m_muxOutput);
+
+					std::vector<std::shared_ptr<ring>> vRings;
+					{
+						std::scoped_lock lockRings(m_muxRings);
+						vRings = m_vRings;
+					}
+
+					for (auto &pRing : vRings)
+						pRing->drain(m_vPending);
+					vRings.clear();
+
+					// Each ring is in order, interleave the threads by time
+					std::stable_sort(m_vPending.begin(), m_vPending.end(),
+						[](const log_record &a, const log_record &b) { return (a.tp < b.tp); });
+
+					m_sOut.clear();
+					m_sErr.clear();
+					for (const auto &record : m_vPending)
+						record.Format(record.level >= log_level::warn ? m_sErr : m_sOut);
+					m_vPending.clear();
+
+					auto write = [](std::ostream *pOutput, const std::string &sText)
+					{
+						if (!sText.empty())
+						{
+							pOutput->write(sText.data(), std::streamsize(sText.size()));
+							pOutput->flush();
+						}
+					};
+					write(m_pOutput, m_sOut);
+					write(m_pErrorOutput, m_sErr);
+
+					// Rings of threads that have finished can go once they are empty
+					std::scoped_lock lockRings(m_muxRings);
+					m_vRings.erase(std::remove_if(m_vRings.begin(), m_vRings.end(),
+						[](const std::shared_ptr<ring> &pRing) { return (pRing.use_count() == 1 && pRing->empty()); }), m_vRings.end());
+				}
+
+				log_stats GetStats() const
+				{
+					log_stats stats;
+					stats.nWritten = m_nWritten.load(std::memory_order_relaxed);
+					stats.nDropped = m_nDropped.load(std::memory_order_relaxed);
+					return (stats);
+				}
+
+			private:
+				logger() = default;
+
+				// The calling thread's ring, made and registered on first use. The
+				// thread holds one reference and the logger another, so whichever
+				// goes last frees it
+				ring &LocalRing()
+				{
+					thread_local std::shared_ptr<ring> pRing;
+					if (!pRing)
+					{
+						pRing = std::make_shared<ring>();
+						std::scoped_lock lock(m_muxRings);
+						m_vRings.push_back(pRing);
+						if (!m_threadFlush.joinable() && !m_bStop)
+							m_threadFlush = std::thread([this]() { FlushThread(); });
+					}
+					return (*pRing);
+				}
+
+				void FlushThread()
+				{
+					std::unique_lock lock(m_muxRings);
+					while (!m_bStop)
+					{
+						m_cvFlush.wait_for(lock, std::chrono::milliseconds(m_tFlushInterval.load(std::memory_order_relaxed)));
+						lock.unlock();
+						Flush();
+						lock.lock();
+					}
+				}
+
+			private:
+				std::atomic<uint8_t> m_nLevel{ uint8_t(log_level::trace) };
+				std::atomic<int64_t> m_tFlushInterval{ 10 };
+				std::atomic<uint64_t> m_nWritten{ 0 };
+				std::atomic<uint64_t> m_nDropped{ 0 };
+
+				std::mutex m_muxRings;
+				std::vector<std::shared_ptr<ring>> m_vRings;
+				std::condition_variable m_cvFlush;
+				std::thread m_threadFlush;
+				bool m_bStop = false;
+
+				// Only the flushing thread touches these
+				std::mutex m_muxOutput;
+				std::ostream *m_pOutput = &std::cout;
+				std::ostream *m_pErrorOutput = &std::cerr;
+				std::vector<log_record> m_vPending;
+				std::string m_sOut;
+				std::string m_sErr;
+		};
+	}
+}
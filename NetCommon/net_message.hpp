@@ -1,12 +1,15 @@
 #pragma once
 #include "net_common.hpp"
+#include "net_body.hpp"
 
 namespace olc
 {
 	namespace net
 	{
 		// Message Header is sent at start of all messages. The template allows us
-		// to use "enum class" to ensure that the messages are valid at compile time
+		// to use "enum class" to ensure that the messages are valid at compile time.
+		// size is the length of the body alone. This struct is never sent as raw
+		// memory - see net_wire.hpp for how it is laid out on the wire
 		template <typename T>
 		struct message_header
 		{
@@ -18,7 +21,7 @@ namespace olc
 		struct message
 		{
 			message_header<T> header{};
-			std::vector<uint8_t> body;
+			message_body<> body;
 
 			// returns size of entire message packet in bytes
 			size_t size() const
@@ -49,8 +52,8 @@ namespace olc
 				// Physically copy the data into the newly allocated vector space
 				std::memcpy(msg.body.data() + i, &data, sizeof(DataType));
 
-				// Recalculate the message size
-				msg.header.size = msg.size();
+				// Recalculate the body size
+				msg.header.size = uint32_t(msg.body.size());
 
 				// Return the target message so it can be "chained"
 				return (msg);
@@ -71,12 +74,73 @@ namespace olc
 				// Shrink the vector to remove read bytes, and reset end position
 				msg.body.resize(i);
 
-				// Recalculate the message size
-				msg.header.size = msg.size();
+				// Recalculate the body size
+				msg.header.size = uint32_t(msg.body.size());
 
 				// Return the target message so it can be "chained"
 				return (msg);
 			}
+
+			// Pushes several POD-like values in one go. The total size is known at
+			// compile time, so the body is resized once and each value copied in
+			// order - the same layout as msg << a << b << c
+			template <typename... DataTypes>
+			message<T> &push(const DataTypes&... data)
+			{
+				static_assert((std::is_standard_layout<DataTypes>::value && ...), "Data is too complex to be pushed into vector");
+
+				constexpr size_t nTotal = (sizeof(DataTypes) + ... + 0);
+				size_t i = body.size();
+				body.resize(i + nTotal);
+
+				uint8_t *p = body.data() + i;
+				((std::memcpy(p, &data, sizeof(DataTypes)), p += sizeof(DataTypes)), ...);
+
+				header.size = uint32_t(body.size());
+				return (*this);
+			}
+
+			// Pulls several values off the end of the body in one go. Arguments are
+			// given in the order they were pushed, so push(a, b, c) pairs with
+			// pop(a, b, c)
+			template <typename... DataTypes>
+			message<T> &pop(DataTypes&... data)
+			{
+				static_assert((std::is_standard_layout<DataTypes>::value && ...), "Data is too complex to be pushed into vector");
+
+				constexpr size_t nTotal = (sizeof(DataTypes) + ... + 0);
+				size_t i = body.size() - nTotal;
+
+				const uint8_t *p = body.data() + i;
+				((std::memcpy(&data, p, sizeof(DataTypes)), p += sizeof(DataTypes)), ...);
+
+				body.resize(i);
+				header.size = uint32_t(body.size());
+				return (*this);
+			}
+		};
+
+		// Builds and parses messages with a fixed layout of fields. The body size
+		// is a compile time constant, so building one costs a single allocation
+		// at most (none at all if it fits inline)
+		template <typename T, typename... DataTypes>
+		struct message_builder
+		{
+			static constexpr size_t nBodySize = (sizeof(DataTypes) + ... + 0);
+
+			static message<T> build(T id, const DataTypes&... data)
+			{
+				message<T> msg;
+				msg.header.id = id;
+				msg.body.reserve(nBodySize);
+				msg.push(data...);
+				return (msg);
+			}
+
+			static void parse(message<T> &msg, DataTypes&... data)
+			{
+				msg.pop(data...);
+			}
 		};
 
 		// Forward declate the connection
@@ -0,0 +1,319 @@
+#pragma once
+#include "net_common.hpp"
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace olc
+{
+	namespace net
+	{
+		// Which shard the calling thread records into. Threads are handed shards
+		// in turn the first time they record anything
+		inline size_t metrics_shard()
+		{
+			static std::atomic<size_t> nNext{ 0 };
+			thread_local size_t nShard = nNext.fetch_add(1, std::memory_order_relaxed);
+			return (nShard);
+		}
+
+		// Monotonic count, split into a cache line per shard so threads counting
+		// at once don't fight over one. Adding is a relaxed add to the thread's
+		// own line; reading sums the lot
+		class counter
+		{
+			public:
+				static constexpr size_t nShards = 16;
+
+			public:
+				void inc(uint64_t n = 1)
+				{
+					m_vShards[metrics_shard() % nShards].n.fetch_add(n, std::memory_order_relaxed);
+				}
+
+				uint64_t value() const
+				{
+					uint64_t nTotal = 0;
+					for (const auto &shard : m_vShards)
+						nTotal += shard.n.load(std::memory_order_relaxed);
+					return (nTotal);
+				}
+
+			private:
+				struct alignas(64) shard
+				{
+					std::atomic<uint64_t> n{ 0 };
+				};
+				std::array<shard, nShards> m_vShards;
+		};
+
+		// A value that goes up and down, such as a number of connections
+		class gauge
+		{
+			public:
+				void set(int64_t n)
+				{
+					m_n.store(n, std::memory_order_relaxed);
+				}
+
+				void add(int64_t n)
+				{
+					m_n.fetch_add(n, std::memory_order_relaxed);
+				}
+
+				void sub(int64_t n)
+				{
+					m_n.fetch_sub(n, std::memory_order_relaxed);
+				}
+
+				int64_t value() const
+				{
+					return (m_n.load(std::memory_order_relaxed));
+				}
+
+			private:
+				alignas(64) std::atomic<int64_t> m_n{ 0 };
+		};
+
+		// A histogram as read at one moment
+		struct histogram_snapshot
+		{
+			uint64_t nCount = 0;
+			uint64_t nSum = 0;
+			uint64_t nMax = 0;
+			std::vector<uint64_t> vBuckets;
+
+			double Mean() const
+			{
+				return (nCount ? double(nSum) / double(nCount) : 0.0);
+			}
+
+			// Upper bound of the bucket holding quantile dQ, 0.0 to 1.0
+			uint64_t Quantile(double dQ) const;
+		};
+
+		// HDR style histogram: buckets are log-linear, eight to each power of
+		// two, so any value is placed to within 12.5% across the whole 64 bit
+		// range with a fixed few hundred buckets. Recording works out the bucket
+		// from the top bit and bumps it in the thread's shard
+		class histogram
+		{
+			public:
+				static constexpr uint32_t nSubBits = 3;
+				static constexpr size_t nBuckets = (64 - nSubBits + 1) << nSubBits;
+				static constexpr size_t nShards = 4;
+
+			public:
+				histogram() : m_vShards(new shard[nShards]) {}
+
+				void record(uint64_t nValue)
+				{
+					shard &s = m_vShards[metrics_shard() % nShards];
+					s.vBuckets[Bucket(nValue)].fetch_add(1, std::memory_order_relaxed);
+					s.nCount.fetch_add(1, std::memory_order_relaxed);
+					s.nSum.fetch_add(nValue, std::memory_order_relaxed);
+
+					uint64_t nMax = s.nMax.load(std::memory_order_relaxed);
+					while (nValue > nMax && !s.nMax.compare_exchange_weak(nMax, nValue, std::memory_order_relaxed));
+				}
+
+				histogram_snapshot snapshot() const
+				{
+					histogram_snapshot snap;
+					snap.vBuckets.assign(nBuckets, 0);
+					for (size_t i = 0; i < nShards; i++)
+					{
+						const shard &s = m_vShards[i];
+						snap.nCount += s.nCount.load(std::memory_order_relaxed);
+						snap.nSum += s.nSum.load(std::memory_order_relaxed);
+						snap.nMax = std::max(snap.nMax, s.nMax.load(std::memory_order_relaxed));
+						for (size_t b = 0; b < nBuckets; b++)
+							snap.vBuckets[b] += s.vBuckets[b].load(std::memory_order_relaxed);
+					}
+					return (snap);
+				}
+
+				static size_t Bucket(uint64_t nValue)
+				{
+					if (nValue < (uint64_t(1) << nSubBits))
+						return (size_t(nValue));
+
+					uint32_t nExp = TopBit(nValue);
+					return (size_t(((nExp - nSubBits + 1) << nSubBits) + ((nValue >> (nExp - nSubBits)) & ((1u << nSubBits) - 1))));
+				}
+
+				// Largest value that lands in a bucket
+				static uint64_t BucketTop(size_t nBucket)
+				{
+					if (nBucket < (size_t(1) << nSubBits))
+						return (nBucket);
+
+					uint32_t nExp = uint32_t(nBucket >> nSubBits) + nSubBits - 1;
+					uint64_t nSub = nBucket & ((1u << nSubBits) - 1);
+					uint64_t nBase = ((uint64_t(1) << nSubBits) + nSub) << (nExp - nSubBits);
+					return (nBase + (uint64_t(1) << (nExp - nSubBits)) - 1);
+				}
+
+			private:
+				static uint32_t TopBit(uint64_t n)
+				{
+#if defined(_MSC_VER)
+					unsigned long nIndex;
+					_BitScanReverse64(&nIndex, n);
+					return (uint32_t(nIndex));
+#else
+					return (uint32_t(63 - __builtin_clzll(n)));
+#endif
+				}
+
+				struct alignas(64) shard
+				{
+					std::array<std::atomic<uint64_t>, nBuckets> vBuckets{};
+					std::atomic<uint64_t> nCount{ 0 };
+					std::atomic<uint64_t> nSum{ 0 };
+					std::atomic<uint64_t> nMax{ 0 };
+				};
+				std::unique_ptr<shard[]> m_vShards;
+		};
+
+		inline uint64_t histogram_snapshot::Quantile(double dQ) const
+		{
+			if (nCount == 0)
+				return (0);
+
+			uint64_t nRank = uint64_t(std::ceil(dQ * double(nCount)));
+			uint64_t nSeen = 0;
+			for (size_t i = 0; i < vBuckets.size(); i++)
+			{
+				nSeen += vBuckets[i];
+				if (nSeen >= nRank && nSeen > 0)
+					return (std::min(histogram::BucketTop(i), nMax));
+			}
+			return (nMax);
+		}
+
+		enum class metric_type
+		{
+			counter,
+			gauge,
+			histogram
+		};
+
+		// One named metric in a registry. A gauge either holds its value or, if
+		// fnValue is set, is worked out each time it is read. Metrics may share
+		// a name if their labels differ, e.g. sLabels = "id=\"3\""
+		struct metric
+		{
+			std::string sName;
+			std::string sLabels;
+			std::string sHelp;
+			metric_type type;
+			std::unique_ptr<olc::net::counter> pCounter;
+			std::unique_ptr<olc::net::gauge> pGauge;
+			std::unique_ptr<olc::net::histogram> pHistogram;
+			std::function<int64_t()> fnValue;
+		};
+
+		// Named metrics, for exporters to walk. Registering takes a lock and
+		// hands back a reference that stays valid for the registry's life, so
+		// look metrics up once and keep the reference for the hot path.
+		// Registering a name and labels twice gives back the first one, and
+		// throws std::logic_error if the type differs. A metric is complete
+		// before it is published and never changes afterwards, so Visit can
+		// run alongside registrations
+		class metrics_registry
+		{
+			public:
+				olc::net::counter &Counter(const std::string &sName, const std::string &sHelp, const std::string &sLabels = "")
+				{
+					return (*Register(sName, sLabels, sHelp, metric_type::counter).pCounter);
+				}
+
+				olc::net::gauge &Gauge(const std::string &sName, const std::string &sHelp)
+				{
+					return (*Register(sName, "", sHelp, metric_type::gauge).pGauge);
+				}
+
+				// A gauge whose value comes from fn whenever it is read. If the
+				// name is already registered fn is dropped. Exporters call fn
+				// under the registry's lock, so it mustn't register metrics
+				void Gauge(const std::string &sName, const std::string &sHelp, std::function<int64_t()> fn)
+				{
+					Register(sName, "", sHelp, metric_type::gauge, std::move(fn));
+				}
+
+				olc::net::histogram &Histogram(const std::string &sName, const std::string &sHelp)
+				{
+					return (*Register(sName, "", sHelp, metric_type::histogram).pHistogram);
+				}
+
+				// Calls fn(const metric &) for each metric, in the order registered,
+				// under the registry's lock. Read what is needed inside fn rather
+				// than keeping the metric, or a pointer into it, for later
+				template <typename Fn>
+				void Visit(Fn &&fn) const
+				{
+					std::scoped_lock lock(m_muxMetrics);
+					for (const auto &pMetric : m_vMetrics)
+						fn(*pMetric);
+				}
+
+			private:
+				// Finds the metric, or builds it whole and only then adds it
+				const metric &Register(const std::string &sName, const std::string &sLabels, const std::string &sHelp, metric_type type,
+					std::function<int64_t()> fnValue = nullptr)
+				{
+					std::scoped_lock lock(m_muxMetrics);
+					for (auto &pMetric : m_vMetrics)
+					{
+						if (pMetric->sName == sName && pMetric->sLabels == sLabels)
+						{
+							if (pMetric->type != type)
+								throw std::logic_error("metric " + sName + " registered again as another type");
+							return (*pMetric);
+						}
+					}
+
+					auto pMetric = std::make_unique<metric>();
+					pMetric->sName = sName;
+					pMetric->sLabels = sLabels;
+					pMetric->sHelp = sHelp;
+					pMetric->type = type;
+					switch (type)
+					{
+					case metric_type::counter:
+						pMetric->pCounter = std::make_unique<olc::net::counter>();
+						break;
+					case metric_type::gauge:
+						pMetric->pGauge = std::make_unique<olc::net::gauge>();
+						pMetric->fnValue = std::move(fnValue);
+						break;
+					case metric_type::histogram:
+						pMetric->pHistogram = std::make_unique<olc::net::histogram>();
+						break;
+					}
+					m_vMetrics.push_back(std::move(pMetric));
+					return (*m_vMetrics.back());
+				}
+
+			private:
+				mutable std::mutex m_muxMetrics;
+				std::vector<std::unique_ptr<metric>> m_vMetrics;
+		};
+
+		// Where a connection records what it does, all owned by its server's
+		// registry
+		struct connection_metrics
+		{
+			counter *pBytesRead = nullptr;
+			counter *pBytesWritten = nullptr;
+			counter *pReads = nullptr;
+			counter *pWrites = nullptr;
+			counter *pMessagesIn = nullptr;
+			counter *pMessagesOut = nullptr;
+			counter *pErrors = nullptr;
+			histogram *pWriteBatch = nullptr;
+		};
+	}
+}
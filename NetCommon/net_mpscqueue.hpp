@@ -0,0 +1,239 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_tsqueue.hpp"
+
+namespace ocl
+{
+	namespace net
+	{
+		// Bounded lock-free multi-producer/single-consumer ring buffer. Any number
+		// of threads may push, but only one thread may front/pop/clear. It offers
+		// the consumer side of tsqueue, so it can stand in for the incoming message
+		// queue of server_interface and client_interface. push_front/pop_back and
+		// back() make no sense for this queue, so they are not provided
+		template <typename T, size_t Capacity = 4096>
+		class mpsc_queue : public queue_sink<T>
+		{
+			static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+			public:
+				mpsc_queue() : vCells(new cell[Capacity])
+				{
+					for (size_t i = 0; i < Capacity; i++)
+						vCells[i].nSequence.store(i, std::memory_order_relaxed);
+				}
+
+				mpsc_queue(const mpsc_queue<T, Capacity>&) = delete;
+				virtual ~mpsc_queue() { clear(); }
+
+			public:
+				// Returns and maintains item at front of Queue - consumer only
+				const T& front()
+				{
+					return (*vCells[nDequeuePos.load(std::memory_order_relaxed) & nMask].item());
+				}
+
+				// Adds an item to back of Queue, yields while the ring is full
+				void push_back(const T& item) override
+				{
+					emplace_back(item);
+				}
+
+				void push_back(T&& item) override
+				{
+					emplace_back(std::move(item));
+				}
+
+				// Constructs an item in place at back of Queue, yields while the ring is full
+				template <typename... Args>
+				void emplace_back(Args&&... args)
+				{
+					// Arguments are only consumed once a slot is claimed, so retrying is safe
+					while (!try_emplace_back(std::forward<Args>(args)...))
+						std::this_thread::yield();
+				}
+
+				// Adds an item to back of Queue, returns false if the ring is full
+				bool try_push_back(const T& item)
+				{
+					return (try_emplace_back(item));
+				}
+
+				bool try_push_back(T&& item)
+				{
+					return (try_emplace_back(std::move(item)));
+				}
+
+				// Constructs an item in place at back of Queue, returns false if the ring is full
+				template <typename... Args>
+				bool try_emplace_back(Args&&... args)
+				{
+					size_t nPos = nEnqueuePos.load(std::memory_order_relaxed);
+					cell* c = nullptr;
+
+					for (;;)
+					{
+						c = &vCells[nPos & nMask];
+						size_t nSeq = c->nSequence.load(std::memory_order_acquire);
+						intptr_t nDiff = intptr_t(nSeq) - intptr_t(nPos);
+
+						if (nDiff == 0)
+						{
+							// Slot is free, try to claim it
+							if (nEnqueuePos.compare_exchange_weak(nPos, nPos + 1, std::memory_order_relaxed))
+								break;
+						}
+						else if (nDiff < 0)
+						{
+							// Consumer hasn't freed this slot yet, the ring is full
+							return (false);
+						}
+						else
+						{
+							// Another producer got here first
+							nPos = nEnqueuePos.load(std::memory_order_relaxed);
+						}
+					}
+
+					new (&c->storage) T(std::forward<Args>(args)...);
+					c->nSequence.store(nPos + 1, std::memory_order_release);
+					notify();
+					return (true);
+				}
+
+				// Returns true if Queue has no items
+				bool empty()
+				{
+					size_t nPos = nDequeuePos.load(std::memory_order_relaxed);
+					return (vCells[nPos & nMask].nSequence.load(std::memory_order_acquire) != nPos + 1);
+				}
+
+				// Returns number of items in Queue. Producers may be part way through
+				// a push, so treat this as approximate
+				size_t count()
+				{
+					size_t nHead = nDequeuePos.load(std::memory_order_relaxed);
+					size_t nTail = nEnqueuePos.load(std::memory_order_relaxed);
+					return (nTail > nHead ? nTail - nHead : 0);
+				}
+
+				// Clears Queue - consumer only
+				void clear()
+				{
+					while (!empty())
+						pop_front();
+				}
+
+				// Removes and returns item from front of Queue - consumer only
+				T pop_front()
+				{
+					size_t nPos = nDequeuePos.load(std::memory_order_relaxed);
+					cell &c = vCells[nPos & nMask];
+
+					T t = std::move(*c.item());
+					c.item()->~T();
+
+					c.nSequence.store(nPos + Capacity, std::memory_order_release);
+					nDequeuePos.store(nPos + 1, std::memory_order_relaxed);
+					return (t);
+				}
+
+				// Moves up to nMax items from front of Queue onto the back of
+				// container, returns how many were moved - consumer only
+				template <typename Container>
+				size_t drain(Container &container, size_t nMax = -1)
+				{
+					size_t nCount = 0;
+					while (nCount < nMax && !empty())
+					{
+						container.push_back(pop_front());
+						nCount++;
+					}
+					return (nCount);
+				}
+
+				// Blocks until Queue has at least one item, or wake is called
+				void wait()
+				{
+					if (!empty()) return;
+
+					std::unique_lock lock(muxSleep);
+					bSleeping.store(true);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					cvBlocking.wait(lock, [this]() { return (!empty() || bWake); });
+					bSleeping.store(false, std::memory_order_relaxed);
+					bWake = false;
+				}
+
+				// Blocks until Queue has at least one item or the timeout elapses,
+				// returns true if there is something to pop
+				template <typename Rep, typename Period>
+				bool wait_for(const std::chrono::duration<Rep, Period> &timeout)
+				{
+					return (wait_until(std::chrono::steady_clock::now() + timeout));
+				}
+
+				// Blocks until Queue has at least one item or the deadline passes,
+				// returns true if there is something to pop
+				template <typename Clock, typename Duration>
+				bool wait_until(const std::chrono::time_point<Clock, Duration> &deadline)
+				{
+					if (!empty()) return (true);
+
+					std::unique_lock lock(muxSleep);
+					bSleeping.store(true);
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					cvBlocking.wait_until(lock, deadline, [this]() { return (!empty() || bWake); });
+					bSleeping.store(false, std::memory_order_relaxed);
+					bWake = false;
+					return (!empty());
+				}
+
+				// Gets the consumer blocked in a wait to return with nothing to pop.
+				// If it isn't waiting, its next wait that would sleep returns
+				// straight away
+				void wake()
+				{
+					{
+						std::scoped_lock lock(muxSleep);
+						bWake = true;
+					}
+					cvBlocking.notify_one();
+				}
+
+			private:
+				// Producers only touch the mutex when the consumer is actually asleep
+				void notify()
+				{
+					std::atomic_thread_fence(std::memory_order_seq_cst);
+					if (bSleeping.load(std::memory_order_relaxed))
+					{
+						std::scoped_lock lock(muxSleep);
+						cvBlocking.notify_one();
+					}
+				}
+
+				struct cell
+				{
+					std::atomic<size_t> nSequence;
+					typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+					T* item() { return (std::launder(reinterpret_cast<T*>(&storage))); }
+				};
+
+				static constexpr size_t nMask = Capacity - 1;
+
+			protected:
+				// Producer and consumer positions live on separate cache lines so
+				// they don't bounce between cores
+				alignas(64) std::atomic<size_t>	nEnqueuePos{ 0 };
+				alignas(64) std::atomic<size_t>	nDequeuePos{ 0 };
+				std::unique_ptr<cell[]>			vCells;
+
+				std::atomic<bool>				bSleeping{ false };
+				std::mutex						muxSleep;
+				std::condition_variable			cvBlocking;
+				bool							bWake = false;
+		};
+	}
+}
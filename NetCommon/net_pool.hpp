@@ -0,0 +1,259 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		struct buffer_pool_stats
+		{
+			// Allocations served from a free list, and those that went to the heap
+			uint64_t nHits = 0;
+			uint64_t nMisses = 0;
+
+			// Bytes sitting in free lists, ready for reuse
+			size_t nRetainedBytes = 0;
+
+			double HitRate() const
+			{
+				uint64_t nTotal = nHits + nMisses;
+				return (nTotal ? double(nHits) / double(nTotal) : 0.0);
+			}
+		};
+
+		// Recycles message body blocks in power-of-two size classes. Each thread
+		// keeps its own free lists, so the usual allocate/release is just a
+		// vector push or pop. Blocks are often released on a different thread
+		// to the one that allocated them (io thread reads, Update frees), so a
+		// thread whose list overflows hands half of it to a shared depot, and a
+		// thread that runs dry takes a batch back. Both the per-thread lists and
+		// the depot are bounded; past that blocks go back to the heap
+		class buffer_pool
+		{
+			public:
+				static constexpr size_t nMinBlock = 128;
+				static constexpr size_t nMaxBlock = 64 * 1024;
+				static constexpr size_t nClasses = 10;
+
+				// Per class limits, in bytes, of what a thread and the depot hold on to
+				static constexpr size_t nThreadBudget = 256 * 1024;
+				static constexpr size_t nDepotBudget = 4 * 1024 * 1024;
+
+			public:
+				// Size a request of nBytes will actually be given. Blocks above the
+				// largest class are not pooled and are returned as asked
+				static size_t RoundUp(size_t nBytes)
+				{
+					if (nBytes > nMaxBlock)
+						return (nBytes);
+
+					size_t nBlock = nMinBlock;
+					while (nBlock < nBytes)
+						nBlock <<= 1;
+					return (nBlock);
+				}
+
+				// nBytes must have come from RoundUp
+				static void *Allocate(size_t nBytes)
+				{
+					if (nBytes > nMaxBlock)
+						return (::operator new(nBytes));
+
+					thread_cache &cache = Cache();
+					size_t nClass = ClassOf(nBytes);
+					std::vector<void*> &vFree = cache.vFree[nClass];
+
+					if (vFree.empty())
+					{
+						size_t nTaken = Depot().Refill(nClass, vFree, Limit(nThreadBudget, nClass) / 2);
+						cache.nRetained.fetch_add(nTaken * nBytes, std::memory_order_relaxed);
+					}
+
+					if (vFree.empty())
+					{
+						cache.nMisses.fetch_add(1, std::memory_order_relaxed);
+						return (::operator new(nBytes));
+					}
+
+					void *p = vFree.back();
+					vFree.pop_back();
+					cache.nHits.fetch_add(1, std::memory_order_relaxed);
+					cache.nRetained.fetch_sub(nBytes, std::memory_order_relaxed);
+					return (p);
+				}
+
+				// nBytes must be the size the block was allocated with
+				static void Release(void *p, size_t nBytes)
+				{
+					if (nBytes > nMaxBlock)
+					{
+						::operator delete(p);
+						return;
+					}
+
+					thread_cache &cache = Cache();
+					size_t nClass = ClassOf(nBytes);
+					std::vector<void*> &vFree = cache.vFree[nClass];
+
+					if (vFree.size() >= Limit(nThreadBudget, nClass))
+					{
+						size_t nSpill = vFree.size() / 2;
+						Depot().Spill(nClass, vFree, nSpill);
+						cache.nRetained.fetch_sub(nSpill * nBytes, std::memory_order_relaxed);
+					}
+
+					vFree.push_back(p);
+					cache.nRetained.fetch_add(nBytes, std::memory_order_relaxed);
+				}
+
+				static buffer_pool_stats GetStats()
+				{
+					return (Depot().GetStats());
+				}
+
+			private:
+				static size_t ClassOf(size_t nBlock)
+				{
+					size_t nClass = 0;
+					while ((nMinBlock << nClass) < nBlock)
+						nClass++;
+					return (nClass);
+				}
+
+				static size_t Limit(size_t nBudget, size_t nClass)
+				{
+					return (std::max<size_t>(nBudget / (nMinBlock << nClass), 4));
+				}
+
+				// Free lists owned by one thread. Counters are atomics only so that
+				// GetStats can read them from elsewhere; the owner is the only writer
+				struct thread_cache
+				{
+					thread_cache();
+					~thread_cache();
+
+					std::array<std::vector<void*>, nClasses> vFree;
+					std::atomic<uint64_t> nHits{ 0 };
+					std::atomic<uint64_t> nMisses{ 0 };
+					std::atomic<size_t> nRetained{ 0 };
+				};
+
+				// Shared overflow for blocks moving between threads, plus the
+				// register of live thread caches for stats
+				class depot
+				{
+					public:
+						~depot()
+						{
+							for (auto &vFree : m_vFree)
+								for (void *p : vFree)
+									::operator delete(p);
+						}
+
+						// Moves up to nMax blocks onto vTo, returns how many
+						size_t Refill(size_t nClass, std::vector<void*> &vTo, size_t nMax)
+						{
+							std::scoped_lock lock(m_mux);
+							std::vector<void*> &vFrom = m_vFree[nClass];
+							size_t n = std::min(nMax, vFrom.size());
+							vTo.insert(vTo.end(), vFrom.end() - n, vFrom.end());
+							vFrom.resize(vFrom.size() - n);
+							m_nRetained -= n * (nMinBlock << nClass);
+							return (n);
+						}
+
+						// Takes nCount blocks off the back of vFrom, freeing any the
+						// depot has no room for
+						void Spill(size_t nClass, std::vector<void*> &vFrom, size_t nCount)
+						{
+							size_t nBlock = nMinBlock << nClass;
+							std::scoped_lock lock(m_mux);
+							std::vector<void*> &vTo = m_vFree[nClass];
+							size_t nLimit = Limit(nDepotBudget, nClass);
+
+							for (size_t i = 0; i < nCount; i++)
+							{
+								void *p = vFrom.back();
+								vFrom.pop_back();
+								if (vTo.size() < nLimit)
+								{
+									vTo.push_back(p);
+									m_nRetained += nBlock;
+								}
+								else
+								{
+									::operator delete(p);
+								}
+							}
+						}
+
+						void Register(thread_cache *cache)
+						{
+							std::scoped_lock lock(m_mux);
+							m_vCaches.push_back(cache);
+						}
+
+						// Folds an exiting thread's counters into the totals and takes
+						// its blocks, as far as there is room
+						void Unregister(thread_cache *cache)
+						{
+							for (size_t nClass = 0; nClass < nClasses; nClass++)
+								Spill(nClass, cache->vFree[nClass], cache->vFree[nClass].size());
+
+							std::scoped_lock lock(m_mux);
+							m_nDeadHits += cache->nHits.load(std::memory_order_relaxed);
+							m_nDeadMisses += cache->nMisses.load(std::memory_order_relaxed);
+							m_vCaches.erase(std::remove(m_vCaches.begin(), m_vCaches.end(), cache), m_vCaches.end());
+						}
+
+						buffer_pool_stats GetStats()
+						{
+							std::scoped_lock lock(m_mux);
+							buffer_pool_stats stats;
+							stats.nHits = m_nDeadHits;
+							stats.nMisses = m_nDeadMisses;
+							stats.nRetainedBytes = m_nRetained;
+
+							for (thread_cache *cache : m_vCaches)
+							{
+								stats.nHits += cache->nHits.load(std::memory_order_relaxed);
+								stats.nMisses += cache->nMisses.load(std::memory_order_relaxed);
+								stats.nRetainedBytes += cache->nRetained.load(std::memory_order_relaxed);
+							}
+							return (stats);
+						}
+
+					private:
+						std::mutex m_mux;
+						std::array<std::vector<void*>, nClasses> m_vFree;
+						size_t m_nRetained = 0;
+
+						std::vector<thread_cache*> m_vCaches;
+						uint64_t m_nDeadHits = 0;
+						uint64_t m_nDeadMisses = 0;
+				};
+
+				static depot &Depot()
+				{
+					static depot d;
+					return (d);
+				}
+
+				static thread_cache &Cache()
+				{
+					thread_local thread_cache cache;
+					return (cache);
+				}
+		};
+
+		inline buffer_pool::thread_cache::thread_cache()
+		{
+			Depot().Register(this);
+		}
+
+		inline buffer_pool::thread_cache::~thread_cache()
+		{
+			Depot().Unregister(this);
+		}
+	}
+}
@@ -0,0 +1,275 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_metrics.hpp"
+#include "net_log.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// Appends a registry in Prometheus' text exposition format. Metrics that
+		// share a name are written together as one family under a single HELP
+		// and TYPE. Histograms get a cumulative bucket at every power of two
+		// across their range, the same ones every time, then +Inf, _sum and
+		// _count
+		inline void write_prometheus(const metrics_registry &registry, std::string &sOut)
+		{
+			// Everything is copied out while the registry is locked, and
+			// formatted once it has been let go
+			struct sample
+			{
+				std::string sName;
+				std::string sLabels;
+				std::string sHelp;
+				metric_type type;
+				uint64_t nCounter;
+				int64_t nGauge;
+				histogram_snapshot snap;
+			};
+
+			std::vector<sample> vSamples;
+			registry.Visit([&vSamples](const metric &m)
+				{
+					sample s{ m.sName, m.sLabels, m.sHelp, m.type, 0, 0, {} };
+					if (m.type == metric_type::counter)
+						s.nCounter = m.pCounter->value();
+					else if (m.type == metric_type::gauge)
+						s.nGauge = m.fnValue ? m.fnValue() : m.pGauge->value();
+					else
+						s.snap = m.pHistogram->snapshot();
+					vSamples.push_back(std::move(s));
+				});
+			std::stable_sort(vSamples.begin(), vSamples.end(),
+				[](const sample &a, const sample &b) { return (a.sName < b.sName); });
+
+			// name{labels} or name{labels,extra}, leaving out empty braces
+			auto series = [&sOut](const std::string &sName, const char *pSuffix, const std::string &sLabels, const std::string &sExtra)
+			{
+				sOut += sName;
+				sOut += pSuffix;
+				if (!sLabels.empty() || !sExtra.empty())
+				{
+					sOut += '{';
+					sOut += sLabels;
+					if (!sLabels.empty() && !sExtra.empty())
+						sOut += ',';
+					sOut += sExtra;
+					sOut += '}';
+				}
+				sOut += ' ';
+			};
+
+			const std::string sNone;
+			const sample *pPrevious = nullptr;
+			for (const sample &m : vSamples)
+			{
+				if (!pPrevious || pPrevious->sName != m.sName)
+				{
+					static const char *vTypes[] = { "counter", "gauge", "histogram" };
+					sOut += "# HELP " + m.sName + " " + m.sHelp + "\n";
+					sOut += "# TYPE " + m.sName + " " + vTypes[size_t(m.type)] + "\n";
+				}
+				pPrevious = &m;
+
+				switch (m.type)
+				{
+				case metric_type::counter:
+					series(m.sName, "", m.sLabels, sNone);
+					sOut += std::to_string(m.nCounter) + "\n";
+					break;
+
+				case metric_type::gauge:
+					series(m.sName, "", m.sLabels, sNone);
+					sOut += std::to_string(m.nGauge) + "\n";
+					break;
+
+				case metric_type::histogram:
+				{
+					const histogram_snapshot &snap = m.snap;
+
+					// The last bucket of every power of two, whatever was recorded,
+					// so each scrape has the same series for rate() to line up
+					uint64_t nCumulative = 0;
+					constexpr size_t nGroup = size_t(1) << histogram::nSubBits;
+					for (size_t i = 0; i < snap.vBuckets.size(); i++)
+					{
+						nCumulative += snap.vBuckets[i];
+						if ((i + 1) % nGroup == 0)
+						{
+							series(m.sName, "_bucket", m.sLabels, "le=\"" + std::to_string(histogram::BucketTop(i)) + "\"");
+							sOut += std::to_string(nCumulative) + "\n";
+						}
+					}
+					series(m.sName, "_bucket", m.sLabels, "le=\"+Inf\"");
+					sOut += std::to_string(snap.nCount) + "\n";
+					series(m.sName, "_sum", m.sLabels, sNone);
+					sOut += std::to_string(snap.nSum) + "\n";
+					series(m.sName, "_count", m.sLabels, sNone);
+					sOut += std::to_string(snap.nCount) + "\n";
+					break;
+				}
+				}
+			}
+		}
+
+		// Answers HTTP GET /metrics with a registry in Prometheus' format, on
+		// whichever io_context it is given. The response is rendered at most
+		// once per cache period and every scrape in between is handed the same
+		// buffer, so the cost of reading the metrics doesn't grow with how
+		// often, or by how many, they are scraped. One request per connection
+		class metrics_endpoint
+		{
+			public:
+				metrics_endpoint(boost::asio::io_context &asioContext, const metrics_registry &registry)
+					: m_registry(registry), m_asioAcceptor(asioContext)
+				{
+
+				}
+
+				// How long a rendered response is reused for
+				void SetCacheTime(std::chrono::milliseconds tCache)
+				{
+					m_tCache = tCache;
+				}
+
+				// Starts listening, throws if the port can't be had. Handlers run
+				// on the io_context, so call before it is running or from it
+				void Start(uint16_t nPort, const std::string &sAddress)
+				{
+					boost::asio::ip::tcp::endpoint endpoint(boost::asio::ip::make_address(sAddress), nPort);
+					m_asioAcceptor.open(endpoint.protocol());
+					m_asioAcceptor.set_option(boost::asio::socket_base::reuse_address(true));
+					m_asioAcceptor.bind(endpoint);
+					m_asioAcceptor.listen();
+					Accept();
+				}
+
+				void Stop()
+				{
+					boost::system::error_code ec;
+					m_asioAcceptor.close(ec);
+				}
+
+			private:
+				// One scrape: read the request, write the response, close
+				struct session
+				{
+					session(boost::asio::ip::tcp::socket socket)
+						: socket(std::move(socket)), timerDeadline(this->socket.get_executor()), request(nMaxRequest)
+					{
+
+					}
+
+					static constexpr size_t nMaxRequest = 4096;
+
+					boost::asio::ip::tcp::socket socket;
+					boost::asio::steady_timer timerDeadline;
+					boost::asio::streambuf request;
+					std::shared_ptr<const std::string> pResponse;
+				};
+
+				void Accept()
+				{
+					m_asioAcceptor.async_accept(
+						[this](std::error_code ec, boost::asio::ip::tcp::socket socket)
+						{
+							if (ec)
+							{
+								// Closed by Stop, or the server is going away
+								if (ec == std::errc::operation_canceled || !m_asioAcceptor.is_open())
+									return;
+								OLC_NET_LOG_WARN("[METRICS] Accept Error: {}", ec);
+							}
+							else
+							{
+								Serve(std::make_shared<session>(std::move(socket)));
+							}
+							Accept();
+						});
+				}
+
+				void Serve(std::shared_ptr<session> s)
+				{
+					// Don't let a client that never finishes its request hold on
+					s->timerDeadline.expires_after(std::chrono::seconds(5));
+					s->timerDeadline.async_wait([s](std::error_code ec)
+						{
+							if (!ec)
+							{
+								boost::system::error_code ecClose;
+								s->socket.close(ecClose);
+							}
+						});
+
+					boost::asio::async_read_until(s->socket, s->request, "\r\n\r\n",
+						[this, s](std::error_code ec, std::size_t length)
+						{
+							if (ec)
+							{
+								s->timerDeadline.cancel();
+								return;
+							}
+
+							// Only the request line matters: method and path
+							std::string_view sRequest(static_cast<const char *>(s->request.data().data()), length);
+							std::string_view sLine = sRequest.substr(0, sRequest.find("\r\n"));
+							if (sLine.substr(0, 4) != "GET ")
+								s->pResponse = Status("405 Method Not Allowed");
+							else if (sLine.substr(4, 9) != "/metrics " && sLine.substr(4, 9) != "/metrics?")
+								s->pResponse = Status("404 Not Found");
+							else
+								s->pResponse = Rendered();
+
+							boost::asio::async_write(s->socket, boost::asio::buffer(*s->pResponse),
+								[s](std::error_code, std::size_t)
+								{
+									boost::system::error_code ecClose;
+									s->socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ecClose);
+									s->socket.close(ecClose);
+									s->timerDeadline.cancel();
+								});
+						});
+				}
+
+				// The whole response, headers and all, re-rendered once it is older
+				// than the cache time. Scrapes already writing the old one keep it
+				// alive until they finish
+				std::shared_ptr<const std::string> Rendered()
+				{
+					auto tpNow = std::chrono::steady_clock::now();
+					if (m_pResponse && tpNow - m_tpRendered < m_tCache)
+						return (m_pResponse);
+
+					m_sBody.clear();
+					write_prometheus(m_registry, m_sBody);
+
+					auto pResponse = std::make_shared<std::string>();
+					pResponse->reserve(m_sBody.size() + 128);
+					*pResponse += "HTTP/1.1 200 OK\r\n";
+					*pResponse += "Content-Type: text/plain; version=0.0.4\r\n";
+					*pResponse += "Content-Length: " + std::to_string(m_sBody.size()) + "\r\n";
+					*pResponse += "Connection: close\r\n\r\n";
+					*pResponse += m_sBody;
+
+					m_pResponse = std::move(pResponse);
+					m_tpRendered = tpNow;
+					return (m_pResponse);
+				}
+
+				static std::shared_ptr<const std::string> Status(const std::string &sStatus)
+				{
+					return (std::make_shared<std::string>("HTTP/1.1 " + sStatus + "\r\nContent-Length: 0\r\nConnection: close\r\n\r\n"));
+				}
+
+			private:
+				const metrics_registry &m_registry;
+				boost::asio::ip::tcp::acceptor m_asioAcceptor;
+
+				// Only touched from the io_context
+				std::chrono::milliseconds m_tCache{ 1000 };
+				std::chrono::steady_clock::time_point m_tpRendered;
+				std::shared_ptr<const std::string> m_pResponse;
+				std::string m_sBody;
+		};
+	}
+}
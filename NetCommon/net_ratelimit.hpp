@@ -0,0 +1,70 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// Inbound limits for one connection. A rate of zero means that dimension
+		// is not limited; a burst of zero allows one second's worth
+		struct rate_limit_config
+		{
+			double dMessagesPerSecond = 0.0;
+			double dMessageBurst = 0.0;
+			double dBytesPerSecond = 0.0;
+			double dByteBurst = 0.0;
+		};
+
+		struct rate_limit_stats
+		{
+			// Times the connection stopped reading to let its buckets refill, and
+			// how long it spent stopped in all
+			uint64_t nThrottles = 0;
+			std::chrono::microseconds tThrottled{ 0 };
+		};
+
+		// Token bucket that refills from timestamps rather than a timer. Taking
+		// more than it holds is allowed and leaves it in debt, so a message
+		// bigger than the burst still gets through - the bucket just has to
+		// refill past zero before the next one
+		class token_bucket
+		{
+			public:
+				void Configure(double dRate, double dBurst)
+				{
+					m_dRate = dRate;
+					m_dBurst = dBurst > 0.0 ? dBurst : dRate;
+					m_dTokens = m_dBurst;
+					m_tpLast = std::chrono::steady_clock::now();
+				}
+
+				bool enabled() const
+				{
+					return (m_dRate > 0.0);
+				}
+
+				void consume(double dTokens)
+				{
+					m_dTokens -= dTokens;
+				}
+
+				// How long until the bucket is out of debt, zero if it isn't
+				std::chrono::nanoseconds wait(std::chrono::steady_clock::time_point tpNow)
+				{
+					std::chrono::duration<double> tElapsed = tpNow - m_tpLast;
+					m_tpLast = tpNow;
+					m_dTokens = std::min(m_dBurst, m_dTokens + tElapsed.count() * m_dRate);
+
+					if (m_dTokens >= 0.0)
+						return (std::chrono::nanoseconds(0));
+					return (std::chrono::nanoseconds(int64_t(-m_dTokens / m_dRate * 1e9) + 1));
+				}
+
+			private:
+				double m_dRate = 0.0;
+				double m_dBurst = 0.0;
+				double m_dTokens = 0.0;
+				std::chrono::steady_clock::time_point m_tpLast;
+		};
+	}
+}
@@ -0,0 +1,121 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_message.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// Read-only view of a run of bytes. The projects build as C++17, so this
+		// stands in for std::span<const uint8_t>
+		class byte_span
+		{
+			public:
+				byte_span() = default;
+				byte_span(const uint8_t *pData, size_t nSize) : m_pData(pData), m_nSize(nSize) {}
+
+				const uint8_t *data() const { return (m_pData); }
+				size_t size() const { return (m_nSize); }
+				bool empty() const { return (m_nSize == 0); }
+
+				const uint8_t *begin() const { return (m_pData); }
+				const uint8_t *end() const { return (m_pData + m_nSize); }
+				const uint8_t &operator[](size_t i) const { return (m_pData[i]); }
+
+				// View of nCount bytes starting at nOffset, clipped to this view
+				byte_span subspan(size_t nOffset, size_t nCount = size_t(-1)) const
+				{
+					nOffset = std::min(nOffset, m_nSize);
+					return (byte_span(m_pData + nOffset, std::min(nCount, m_nSize - nOffset)));
+				}
+
+			private:
+				const uint8_t *m_pData = nullptr;
+				size_t m_nSize = 0;
+		};
+
+		// Walks forward through a message body without modifying it. Fields come
+		// out in the order they were pushed, and since the body is only viewed,
+		// the same message can be handed to any number of readers. Every read is
+		// bounds checked: a read that would run off the end fails, leaves the
+		// cursor where it was and marks the reader as failed
+		class message_reader
+		{
+			public:
+				explicit message_reader(byte_span span) : m_span(span) {}
+
+				template <typename T>
+				explicit message_reader(const message<T> &msg) : m_span(msg.body.data(), msg.body.size()) {}
+
+			public:
+				// Copies out one or more POD-like values, all or nothing
+				template <typename... DataTypes>
+				bool read(DataTypes&... data)
+				{
+					static_assert((std::is_standard_layout<DataTypes>::value && ...), "Data is too complex to be read from message");
+
+					constexpr size_t nTotal = (sizeof(DataTypes) + ... + 0);
+					if (!check(nTotal))
+						return (false);
+
+					((std::memcpy(&data, m_span.data() + m_nPos, sizeof(DataTypes)), m_nPos += sizeof(DataTypes)), ...);
+					return (true);
+				}
+
+				// Stream style read, check good() once at the end of a chain
+				template <typename DataType>
+				message_reader &operator>>(DataType &data)
+				{
+					read(data);
+					return (*this);
+				}
+
+				// Returns a view of the next nCount bytes without copying them. The
+				// view is only valid for as long as the message body is
+				byte_span read_span(size_t nCount)
+				{
+					if (!check(nCount))
+						return (byte_span());
+
+					byte_span span = m_span.subspan(m_nPos, nCount);
+					m_nPos += nCount;
+					return (span);
+				}
+
+				// Moves the cursor past nCount bytes
+				bool skip(size_t nCount)
+				{
+					if (!check(nCount))
+						return (false);
+
+					m_nPos += nCount;
+					return (true);
+				}
+
+				size_t position() const { return (m_nPos); }
+				size_t remaining() const { return (m_span.size() - m_nPos); }
+
+				// View of whatever has not been read yet
+				byte_span rest() const { return (m_span.subspan(m_nPos)); }
+
+				// False once any read has run off the end
+				bool good() const { return (!m_bFailed); }
+
+			private:
+				bool check(size_t nCount)
+				{
+					if (nCount > remaining())
+					{
+						m_bFailed = true;
+						return (false);
+					}
+					return (true);
+				}
+
+			private:
+				byte_span m_span;
+				size_t m_nPos = 0;
+				bool m_bFailed = false;
+		};
+	}
+}
@@ -0,0 +1,129 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// The message id the framework keeps for its own ping/pong: the largest
+		// value T can hold. Connections answer these themselves and never pass
+		// them on, so don't use it for your own messages
+		template <typename T>
+		constexpr T ping_id()
+		{
+			if constexpr (std::is_enum_v<T>)
+				return (T(std::numeric_limits<std::underlying_type_t<T>>::max()));
+			else
+				return (std::numeric_limits<T>::max());
+		}
+
+		// Round trip times measured by ping/pong on one connection
+		struct rtt_stats
+		{
+			std::chrono::microseconds tMin{ 0 };
+			std::chrono::microseconds tAvg{ 0 };
+			std::chrono::microseconds tP99{ 0 };
+			std::chrono::microseconds tLast{ 0 };
+			uint64_t nSamples = 0;
+		};
+
+		// Keeps an EWMA of round trip times, as TCP does for SRTT, and a small
+		// log-linear histogram for the tail. The histogram is halved every
+		// nDecaySamples so p99 follows recent behaviour rather than the whole
+		// connection's life. Samples come from the connection's io thread;
+		// GetStats may be called from anywhere
+		class rtt_tracker
+		{
+			public:
+				// Four buckets per power of two, so a bucket is at most 25% wide,
+				// up to about 18 minutes
+				static constexpr uint32_t nSubBits = 2;
+				static constexpr uint32_t nMaxBits = 30;
+				static constexpr size_t nBuckets = (nMaxBits - nSubBits + 2) << nSubBits;
+				static constexpr uint64_t nDecaySamples = 256;
+
+			public:
+				void AddSample(std::chrono::microseconds tRTT)
+				{
+					uint64_t nRTT = uint64_t(std::max<int64_t>(tRTT.count(), 0));
+					uint64_t nSamples = m_nSamples.load(std::memory_order_relaxed);
+
+					// EWMA with a gain of 1/8, seeded by the first sample
+					uint64_t nAvg = m_nAvg.load(std::memory_order_relaxed);
+					nAvg = nSamples == 0 ? nRTT : uint64_t(int64_t(nAvg) + (int64_t(nRTT) - int64_t(nAvg)) / 8);
+					m_nAvg.store(nAvg, std::memory_order_relaxed);
+
+					if (nSamples == 0 || nRTT < m_nMin.load(std::memory_order_relaxed))
+						m_nMin.store(nRTT, std::memory_order_relaxed);
+					m_nLast.store(nRTT, std::memory_order_relaxed);
+
+					if (++m_nSinceDecay >= nDecaySamples)
+					{
+						for (auto &nCount : m_vBuckets)
+							nCount.store(nCount.load(std::memory_order_relaxed) / 2, std::memory_order_relaxed);
+						m_nSinceDecay = 0;
+					}
+					m_vBuckets[Bucket(nRTT)].fetch_add(1, std::memory_order_relaxed);
+					m_nSamples.store(nSamples + 1, std::memory_order_relaxed);
+				}
+
+				rtt_stats GetStats() const
+				{
+					rtt_stats stats;
+					stats.nSamples = m_nSamples.load(std::memory_order_relaxed);
+					stats.tMin = std::chrono::microseconds(m_nMin.load(std::memory_order_relaxed));
+					stats.tAvg = std::chrono::microseconds(m_nAvg.load(std::memory_order_relaxed));
+					stats.tLast = std::chrono::microseconds(m_nLast.load(std::memory_order_relaxed));
+
+					std::array<uint64_t, nBuckets> vCounts;
+					uint64_t nTotal = 0;
+					for (size_t i = 0; i < nBuckets; i++)
+						nTotal += vCounts[i] = m_vBuckets[i].load(std::memory_order_relaxed);
+
+					// Report the top of the bucket holding the 99th percentile
+					uint64_t nRank = nTotal - nTotal / 100, nSeen = 0;
+					for (size_t i = 0; i < nBuckets && nTotal > 0; i++)
+					{
+						nSeen += vCounts[i];
+						if (nSeen >= nRank)
+						{
+							stats.tP99 = std::chrono::microseconds(BucketTop(i));
+							break;
+						}
+					}
+					return (stats);
+				}
+
+			private:
+				static size_t Bucket(uint64_t nValue)
+				{
+					nValue = std::min<uint64_t>(nValue, (uint64_t(1) << (nMaxBits + 1)) - 1);
+					if (nValue < (1u << nSubBits))
+						return (size_t(nValue));
+
+					uint32_t nExp = 0;
+					while ((nValue >> (nExp + 1)) != 0)
+						nExp++;
+					return (size_t(((nExp - nSubBits + 1) << nSubBits) + ((nValue >> (nExp - nSubBits)) & ((1u << nSubBits) - 1))));
+				}
+
+				static uint64_t BucketTop(size_t nBucket)
+				{
+					if (nBucket < (1u << nSubBits))
+						return (nBucket);
+
+					uint32_t nExp = uint32_t(nBucket >> nSubBits) + nSubBits - 1;
+					uint64_t nSub = nBucket & ((1u << nSubBits) - 1);
+					return ((((uint64_t(1) << nSubBits) + nSub + 1) << (nExp - nSubBits)) - 1);
+				}
+
+			private:
+				std::array<std::atomic<uint64_t>, nBuckets> m_vBuckets{};
+				std::atomic<uint64_t> m_nSamples{ 0 };
+				std::atomic<uint64_t> m_nMin{ 0 };
+				std::atomic<uint64_t> m_nAvg{ 0 };
+				std::atomic<uint64_t> m_nLast{ 0 };
+				uint64_t m_nSinceDecay = 0;
+		};
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// Generational slot map. Values are stored densely in one vector, so
+		// iterating them is a linear walk; keys stay valid however the values
+		// move around. A key packs a slot index (low 20 bits) with the slot's
+		// generation (high 44 bits), which is bumped on every erase, so a stale
+		// key doesn't find whatever reused its slot. A slot whose generation
+		// would wrap is retired rather than reused, so no key is ever handed
+		// out twice - at a million reuses a second a slot lasts over 200 days.
+		// Insert, find and erase are O(1). Key 0 is never handed out
+		template <typename V>
+		class slot_map
+		{
+			public:
+				static constexpr uint32_t nIndexBits = 20;
+				static constexpr uint64_t nIndexMask = (uint64_t(1) << nIndexBits) - 1;
+				static constexpr uint32_t nMaxSlots = nIndexMask + 1;
+
+			public:
+				// Returns the new value's key, or 0 if every slot is in use
+				uint64_t insert(V value)
+				{
+					uint32_t nIndex;
+					if (m_nFreeHead != nNone)
+					{
+						nIndex = m_nFreeHead;
+						m_nFreeHead = m_vSlots[nIndex].nLink;
+					}
+					else
+					{
+						if (m_vSlots.size() >= nMaxSlots)
+							return (0);
+						nIndex = uint32_t(m_vSlots.size());
+						m_vSlots.push_back({ 1, nNone });
+					}
+
+					slot &s = m_vSlots[nIndex];
+					s.nLink = uint32_t(m_vValues.size());
+					m_vValues.push_back(std::move(value));
+					m_vKeys.push_back(MakeKey(nIndex, s.nGeneration));
+					return (m_vKeys.back());
+				}
+
+				// Returns the value for key, or nullptr if it has been erased
+				V *find(uint64_t nKey)
+				{
+					uint32_t nIndex = uint32_t(nKey & nIndexMask);
+					if (nIndex >= m_vSlots.size() || MakeKey(nIndex, m_vSlots[nIndex].nGeneration) != nKey
+						|| m_vSlots[nIndex].nLink >= m_vValues.size() || m_vKeys[m_vSlots[nIndex].nLink] != nKey)
+						return (nullptr);
+					return (&m_vValues[m_vSlots[nIndex].nLink]);
+				}
+
+				// Removes key's value by moving the last value into its place.
+				// Returns false if key was already gone
+				bool erase(uint64_t nKey)
+				{
+					if (!find(nKey))
+						return (false);
+
+					uint32_t nIndex = uint32_t(nKey & nIndexMask);
+					slot &s = m_vSlots[nIndex];
+					uint32_t nDense = s.nLink;
+
+					if (nDense != m_vValues.size() - 1)
+					{
+						m_vValues[nDense] = std::move(m_vValues.back());
+						m_vKeys[nDense] = m_vKeys.back();
+						m_vSlots[m_vKeys[nDense] & nIndexMask].nLink = nDense;
+					}
+					m_vValues.pop_back();
+					m_vKeys.pop_back();
+
+					// Retire this generation of the slot and put it on the free list,
+					// unless it has used up its generations
+					if (s.nGeneration == nGenerationMask)
+					{
+						s.nLink = nNone;
+						return (true);
+					}
+					s.nGeneration++;
+					s.nLink = m_nFreeHead;
+					m_nFreeHead = nIndex;
+					return (true);
+				}
+
+				size_t size() const { return (m_vValues.size()); }
+				bool empty() const { return (m_vValues.empty()); }
+
+				// Dense, contiguous iteration over the values
+				typename std::vector<V>::iterator begin() { return (m_vValues.begin()); }
+				typename std::vector<V>::iterator end() { return (m_vValues.end()); }
+
+				// Key of the value at a dense position
+				uint64_t key_at(size_t i) const { return (m_vKeys[i]); }
+
+			private:
+				static constexpr uint64_t nGenerationMask = (uint64_t(1) << (64 - nIndexBits)) - 1;
+				static constexpr uint32_t nNone = uint32_t(-1);
+
+				static uint64_t MakeKey(uint32_t nIndex, uint64_t nGeneration)
+				{
+					return ((nGeneration << nIndexBits) | nIndex);
+				}
+
+				// A live slot's link is its value's dense position, a free slot's
+				// link is the next free slot
+				struct slot
+				{
+					uint64_t nGeneration;
+					uint32_t nLink;
+				};
+
+			private:
+				std::vector<V> m_vValues;
+				std::vector<uint64_t> m_vKeys;
+				std::vector<slot> m_vSlots;
+				uint32_t m_nFreeHead = nNone;
+		};
+	}
+}
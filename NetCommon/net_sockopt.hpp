@@ -0,0 +1,85 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// Socket tuning for connections. Zero or false leaves the OS default;
+		// options the platform doesn't have are skipped
+		struct socket_options
+		{
+			// TCP_NODELAY - send small writes straight away rather than waiting
+			// for outstanding data to be acknowledged (Nagle). Framework pings
+			// only measure the link when both ends have it on
+			bool bNoDelay = false;
+
+			// SO_SNDBUF / SO_RCVBUF in bytes
+			int nSendBuffer = 0;
+			int nReceiveBuffer = 0;
+
+			// TCP_NOTSENT_LOWAT - limit on unsent bytes the kernel holds before
+			// the socket stops being writable, keeps queueing in user space
+			// where priorities still apply
+			int nNotSentLowat = 0;
+
+			// TCP_QUICKACK - acknowledge straight away instead of delaying. Linux
+			// clears it as it goes, so connections set it again after every read
+			bool bQuickAck = false;
+
+			// SO_BUSY_POLL - microseconds to busy poll the device on a blocking
+			// read, Linux only and may need CAP_NET_ADMIN
+			int nBusyPollMicros = 0;
+
+			// Listen queue length for a server, zero for SOMAXCONN
+			int nListenBacklog = 0;
+		};
+
+		// Applies options to a socket, carrying on past any that fail. Returns
+		// the first failure, if there was one
+		template <typename Socket>
+		std::error_code apply_socket_options(Socket &socket, const socket_options &options)
+		{
+			std::error_code ecFirst;
+			auto set = [&socket, &ecFirst](const auto &option)
+			{
+				boost::system::error_code ec;
+				socket.set_option(option, ec);
+				if (ec && !ecFirst)
+					ecFirst = ec;
+			};
+
+			if (options.bNoDelay)
+				set(boost::asio::ip::tcp::no_delay(true));
+			if (options.nSendBuffer > 0)
+				set(boost::asio::socket_base::send_buffer_size(options.nSendBuffer));
+			if (options.nReceiveBuffer > 0)
+				set(boost::asio::socket_base::receive_buffer_size(options.nReceiveBuffer));
+#ifdef TCP_NOTSENT_LOWAT
+			if (options.nNotSentLowat > 0)
+				set(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_NOTSENT_LOWAT>(options.nNotSentLowat));
+#endif
+#ifdef TCP_QUICKACK
+			if (options.bQuickAck)
+				set(boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_QUICKACK>(true));
+#endif
+#ifdef SO_BUSY_POLL
+			if (options.nBusyPollMicros > 0)
+				set(boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>(options.nBusyPollMicros));
+#endif
+			return (ecFirst);
+		}
+
+		// The options a listening socket can usefully take: accepted sockets
+		// inherit their buffer sizes, which then count towards the window
+		// offered in the handshake
+		template <typename Acceptor>
+		std::error_code apply_listen_options(Acceptor &acceptor, const socket_options &options)
+		{
+			socket_options buffers;
+			buffers.nSendBuffer = options.nSendBuffer;
+			buffers.nReceiveBuffer = options.nReceiveBuffer;
+			return (apply_socket_options(acceptor, buffers));
+		}
+	}
+}
@@ -0,0 +1,380 @@
+#pragma once
+#include "net_common.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// Handle to a scheduled timer, 0 is never a valid one
+		using timer_id = uint64_t;
+
+		struct timer_stats
+		{
+			size_t nPending = 0;
+			uint64_t nFired = 0;
+			uint64_t nTicks = 0;
+
+			// How late the wheel turned, against when it should have, on the
+			// last tick and at worst since Start. A lag well over the tick
+			// means the context thread is too busy to keep time
+			std::chrono::microseconds tLagLast{ 0 };
+			std::chrono::microseconds tLagMax{ 0 };
+		};
+
+		// Hierarchical timing wheel. Every timer lives in one slot of one of
+		// nLevels wheels of nSlots each, level n covering nSlots^(n+1) ticks; as
+		// the level 0 wheel wraps, the next level's current slot is spread back
+		// down. Schedule, Reschedule and Cancel are O(1), and however many timers
+		// there are, the io context only ever sees one steady_timer for the tick.
+		// Callbacks run on that context, outside the wheel's lock, so they may
+		// schedule or cancel timers themselves
+		class timer_wheel
+		{
+			public:
+				static constexpr uint32_t nSlotBits = 6;
+				static constexpr uint32_t nSlots = 1u << nSlotBits;
+				static constexpr uint32_t nLevels = 4;
+
+			public:
+				timer_wheel(boost::asio::io_context &asioContext, std::chrono::milliseconds tTick = std::chrono::milliseconds(10))
+					: m_asioContext(asioContext), m_timer(asioContext), m_tTick(tTick)
+				{
+					m_vHeads.fill(nNone);
+				}
+
+				timer_wheel(const timer_wheel &) = delete;
+				timer_wheel &operator=(const timer_wheel &) = delete;
+
+				// Starts turning the wheel, timers may be scheduled before this
+				void Start()
+				{
+					m_tpStart = std::chrono::steady_clock::now();
+					m_tpNextTick = m_tpStart + m_tTick;
+					WaitForTick();
+				}
+
+				void Stop()
+				{
+					boost::asio::post(m_asioContext, [this]() { m_timer.cancel(); });
+				}
+
+				std::chrono::milliseconds GetTick() const
+				{
+					return (m_tTick);
+				}
+
+				// Calls fn once, after at least tDelay
+				template <typename Rep, typename Period>
+				timer_id Schedule(std::chrono::duration<Rep, Period> tDelay, std::function<void()> fn)
+				{
+					return (Add(ToTicks(tDelay), 0, std::move(fn)));
+				}
+
+				// Calls fn every tInterval until cancelled
+				template <typename Rep, typename Period>
+				timer_id ScheduleEvery(std::chrono::duration<Rep, Period> tInterval, std::function<void()> fn)
+				{
+					uint64_t nTicks = ToTicks(tInterval);
+					return (Add(nTicks, nTicks, std::move(fn)));
+				}
+
+				// Moves a pending timer to fire after tDelay instead. Also works from
+				// inside the timer's own callback, to re-arm a one-shot timer without
+				// changing its id. False if the timer has fired or been cancelled
+				template <typename Rep, typename Period>
+				bool Reschedule(timer_id nID, std::chrono::duration<Rep, Period> tDelay)
+				{
+					std::scoped_lock lock(m_muxWheel);
+					uint32_t nIndex = Lookup(nID);
+					if (nIndex == nNone)
+						return (false);
+
+					node &n = m_vNodes[nIndex];
+					if (n.nState == state::pending)
+						Unlink(nIndex);
+					n.nExpiry = m_nNow + ToTicks(tDelay);
+					n.nState = state::pending;
+					Link(nIndex);
+					return (true);
+				}
+
+				// False if the timer had already fired or been cancelled
+				bool Cancel(timer_id nID)
+				{
+					std::function<void()> fn;
+					{
+						std::scoped_lock lock(m_muxWheel);
+						uint32_t nIndex = Lookup(nID);
+						if (nIndex == nNone)
+							return (false);
+
+						if (m_vNodes[nIndex].nState == state::pending)
+							Unlink(nIndex);
+						fn = Free(nIndex);
+					}
+
+					// fn's captures are destroyed here, outside the lock
+					return (true);
+				}
+
+				timer_stats GetStats()
+				{
+					std::scoped_lock lock(m_muxWheel);
+					timer_stats stats;
+					stats.nPending = m_nPending;
+					stats.nFired = m_nFired;
+					stats.nTicks = m_nNow;
+					stats.tLagLast = m_tLagLast;
+					stats.tLagMax = m_tLagMax;
+					return (stats);
+				}
+
+			private:
+				enum class state : uint8_t
+				{
+					free,
+					pending,
+					firing
+				};
+
+				struct node
+				{
+					uint64_t nExpiry = 0;
+					uint64_t nInterval = 0;
+					uint32_t nGeneration = 1;
+					uint32_t nPrev = nNone;
+					uint32_t nNext = nNone;
+					uint16_t nSlot = 0;
+					state nState = state::free;
+					std::function<void()> fn;
+				};
+
+				static constexpr uint32_t nNone = std::numeric_limits<uint32_t>::max();
+
+				template <typename Rep, typename Period>
+				uint64_t ToTicks(std::chrono::duration<Rep, Period> tDelay) const
+				{
+					// Round up, a timer never fires early
+					auto nTick = std::chrono::duration_cast<std::chrono::nanoseconds>(m_tTick).count();
+					auto nTicks = (std::chrono::duration_cast<std::chrono::nanoseconds>(tDelay).count() + nTick - 1) / nTick;
+					return (nTicks > 0 ? uint64_t(nTicks) : 1);
+				}
+
+				timer_id Add(uint64_t nTicks, uint64_t nInterval, std::function<void()> fn)
+				{
+					std::scoped_lock lock(m_muxWheel);
+					uint32_t nIndex;
+					if (m_nFreeHead != nNone)
+					{
+						nIndex = m_nFreeHead;
+						m_nFreeHead = m_vNodes[nIndex].nNext;
+					}
+					else
+					{
+						nIndex = uint32_t(m_vNodes.size());
+						m_vNodes.emplace_back();
+					}
+
+					node &n = m_vNodes[nIndex];
+					n.nExpiry = m_nNow + nTicks;
+					n.nInterval = nInterval;
+					n.nState = state::pending;
+					n.fn = std::move(fn);
+					Link(nIndex);
+					m_nPending++;
+					return ((uint64_t(n.nGeneration) << 32) | nIndex);
+				}
+
+				// Index of a live timer, or nNone
+				uint32_t Lookup(timer_id nID) const
+				{
+					uint32_t nIndex = uint32_t(nID);
+					if (nIndex >= m_vNodes.size() || m_vNodes[nIndex].nState == state::free || m_vNodes[nIndex].nGeneration != uint32_t(nID >> 32))
+						return (nNone);
+					return (nIndex);
+				}
+
+				// Returns the node's callback so the caller can drop it unlocked
+				std::function<void()> Free(uint32_t nIndex)
+				{
+					node &n = m_vNodes[nIndex];
+					n.nState = state::free;
+					if (++n.nGeneration == 0)
+						n.nGeneration = 1;
+					n.nNext = m_nFreeHead;
+					m_nFreeHead = nIndex;
+					m_nPending--;
+					return (std::move(n.fn));
+				}
+
+				// Slot for a timer due at nExpiry, given the wheel is at m_nNow
+				uint16_t SlotFor(uint64_t nExpiry) const
+				{
+					uint64_t nDelta = nExpiry > m_nNow ? nExpiry - m_nNow : 0;
+					for (uint32_t nLevel = 0; nLevel < nLevels; nLevel++)
+					{
+						if (nDelta < (uint64_t(1) << (nSlotBits * (nLevel + 1))))
+							return (uint16_t(nLevel * nSlots + ((nExpiry >> (nSlotBits * nLevel)) & (nSlots - 1))));
+					}
+
+					// Further out than the wheel reaches - park it in the last slot
+					// of the top level, and it is placed again when that comes round
+					uint32_t nTop = nLevels - 1;
+					return (uint16_t(nTop * nSlots + (((m_nNow >> (nSlotBits * nTop)) - 1) & (nSlots - 1))));
+				}
+
+				void Link(uint32_t nIndex)
+				{
+					node &n = m_vNodes[nIndex];
+					n.nSlot = SlotFor(n.nExpiry);
+					n.nPrev = nNone;
+					n.nNext = m_vHeads[n.nSlot];
+					if (n.nNext != nNone)
+						m_vNodes[n.nNext].nPrev = nIndex;
+					m_vHeads[n.nSlot] = nIndex;
+				}
+
+				void Unlink(uint32_t nIndex)
+				{
+					node &n = m_vNodes[nIndex];
+					if (n.nPrev != nNone)
+						m_vNodes[n.nPrev].nNext = n.nNext;
+					else
+						m_vHeads[n.nSlot] = n.nNext;
+					if (n.nNext != nNone)
+						m_vNodes[n.nNext].nPrev = n.nPrev;
+				}
+
+				// Takes a whole slot's list, leaving the slot empty
+				uint32_t TakeSlot(uint32_t nSlot)
+				{
+					uint32_t nHead = m_vHeads[nSlot];
+					m_vHeads[nSlot] = nNone;
+					return (nHead);
+				}
+
+				// ASYNC - Wait for the next tick, measured from Start rather than from
+				// the last one, so the wheel doesn't drift
+				void WaitForTick()
+				{
+					m_timer.expires_at(m_tpNextTick);
+					m_timer.async_wait(
+						[this](std::error_code ec)
+						{
+							if (ec)
+								return;
+
+							auto tpNow = std::chrono::steady_clock::now();
+							{
+								std::scoped_lock lock(m_muxWheel);
+								m_tLagLast = std::chrono::duration_cast<std::chrono::microseconds>(tpNow - m_tpNextTick);
+								m_tLagMax = std::max(m_tLagMax, m_tLagLast);
+							}
+
+							// Catch up on every tick that has passed, if we were late
+							uint64_t nTarget = uint64_t((tpNow - m_tpStart) / m_tTick);
+							while (m_nNow < nTarget)
+								Advance();
+
+							m_tpNextTick = m_tpStart + m_tTick * (nTarget + 1);
+							WaitForTick();
+						});
+				}
+
+				// Moves the wheel on one tick and runs whatever is due
+				void Advance()
+				{
+					struct due_timer
+					{
+						uint32_t nIndex;
+						uint32_t nGeneration;
+						std::function<void()> fn;
+					};
+					std::vector<due_timer> vDue;
+					{
+						std::scoped_lock lock(m_muxWheel);
+						m_nNow++;
+
+						// Spread each higher level's current slot back down as the
+						// level below it wraps, the highest first
+						uint32_t nWrapped = 0;
+						while (nWrapped + 1 < nLevels && ((m_nNow >> (nSlotBits * (nWrapped + 1))) << (nSlotBits * (nWrapped + 1))) == m_nNow)
+							nWrapped++;
+						for (uint32_t nLevel = nWrapped; nLevel > 0; nLevel--)
+						{
+							uint32_t nIndex = TakeSlot(nLevel * nSlots + ((m_nNow >> (nSlotBits * nLevel)) & (nSlots - 1)));
+							while (nIndex != nNone)
+							{
+								uint32_t nNext = m_vNodes[nIndex].nNext;
+								Link(nIndex);
+								nIndex = nNext;
+							}
+						}
+
+						uint32_t nIndex = TakeSlot(m_nNow & (nSlots - 1));
+						while (nIndex != nNone)
+						{
+							node &n = m_vNodes[nIndex];
+							uint32_t nNext = n.nNext;
+
+							// Repeating timers go straight back in, so they keep
+							// their place even if the callback is slow
+							if (n.nInterval > 0)
+							{
+								n.nExpiry = m_nNow + n.nInterval;
+								Link(nIndex);
+							}
+							else
+							{
+								n.nState = state::firing;
+							}
+							vDue.push_back({ nIndex, n.nGeneration, std::move(n.fn) });
+							nIndex = nNext;
+						}
+					}
+
+					if (vDue.empty())
+						return;
+
+					for (auto &due : vDue)
+						due.fn();
+
+					// Hand the callbacks back to timers that are still live, and
+					// retire one-shots that weren't re-armed from their callback.
+					// Anything cancelled meanwhile has its callback dropped once
+					// vDue goes, after the lock
+					std::scoped_lock lock(m_muxWheel);
+					m_nFired += vDue.size();
+					for (auto &due : vDue)
+					{
+						node &n = m_vNodes[due.nIndex];
+						if (n.nState == state::free || n.nGeneration != due.nGeneration)
+							continue;
+						if (n.nState == state::firing)
+							Free(due.nIndex);
+						else
+							n.fn = std::move(due.fn);
+					}
+				}
+
+			private:
+				boost::asio::io_context &m_asioContext;
+				boost::asio::steady_timer m_timer;
+				std::chrono::milliseconds m_tTick;
+
+				std::mutex m_muxWheel;
+				std::vector<node> m_vNodes;
+				std::array<uint32_t, nLevels * nSlots> m_vHeads;
+				uint32_t m_nFreeHead = nNone;
+				size_t m_nPending = 0;
+				uint64_t m_nFired = 0;
+
+				// Ticks since Start; the wheel's idea of now
+				uint64_t m_nNow = 0;
+				std::chrono::steady_clock::time_point m_tpStart = std::chrono::steady_clock::now();
+				std::chrono::steady_clock::time_point m_tpNextTick = m_tpStart;
+				std::chrono::microseconds m_tLagLast{ 0 };
+				std::chrono::microseconds m_tLagMax{ 0 };
+		};
+	}
+}
@@ -5,12 +5,64 @@ namespace ocl
 {
 	namespace net
 	{
+		// Producer side of an incoming queue. Connections only ever push into
+		// the queue their owner gave them, so they talk to it through this and
+		// the owner is free to pick whichever queue implementation suits it
 		template <typename T>
-		class tsqueue
+		class queue_sink
 		{
+			public:
+				virtual ~queue_sink() = default;
+
+				// Adds an item to back of Queue
+				virtual void push_back(const T& item) = 0;
+				virtual void push_back(T&& item) = 0;
+		};
+
+		// Synchronisation policies for tsqueue, chosen at compile time
+
+		// No locking at all, for a queue that is only ever touched by one thread
+		// (or one strand). The lock calls are empty and inline away completely
+		struct null_lock
+		{
+			struct mutex_type
+			{
+				void lock() {}
+				void unlock() {}
+				bool try_lock() { return (true); }
+			};
+
+			static constexpr bool blocking = false;
+		};
+
+		// A plain mutex, safe for any number of producers and consumers
+		struct mutex_lock
+		{
+			using mutex_type = std::mutex;
+
+			static constexpr bool blocking = true;
+		};
+
+		// Lock-free bounded ring for exactly one producer thread and one
+		// consumer thread. Capacity must be a power of two
+		template <size_t Capacity = 1024>
+		struct spsc_lock
+		{
+			static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+		};
+
+		template <typename T, typename SyncPolicy = mutex_lock>
+		class tsqueue : public queue_sink<T>
+		{
+			using mutex_type = typename SyncPolicy::mutex_type;
+
+			// Only a blocking policy can have consumers sleep on the queue
+			struct no_condition {};
+			using condition_type = std::conditional_t<SyncPolicy::blocking, std::condition_variable, no_condition>;
+
 			public:
 				tsqueue() = default;
-				tsqueue(const tsqueue<T>&) = delete;
+				tsqueue(const tsqueue<T, SyncPolicy>&) = delete;
 				virtual ~tsqueue() { clear(); }
 
 			public:
@@ -29,17 +81,43 @@ namespace ocl
 				}
 
 				// Adds an item to back of Queue
-				void push_back(const T& item)
+				void push_back(const T& item) override
 				{
-					std::scoped_lock lock(muxQueue);
-					deqQueue.emplace_back(std::move(item));
+					emplace_back(item);
+				}
+
+				void push_back(T&& item) override
+				{
+					emplace_back(std::move(item));
+				}
+
+				// Constructs an item in place at back of Queue
+				template <typename... Args>
+				void emplace_back(Args&&... args)
+				{
+					std::unique_lock lock(muxQueue);
+					deqQueue.emplace_back(std::forward<Args>(args)...);
+					notify(lock);
 				}
 
 				// Adds an item to front of Queue
 				void push_front(const T& item)
 				{
-					std::scoped_lock lock(muxQueue);
-					deqQueue.emplace_front(std::move(item));
+					emplace_front(item);
+				}
+
+				void push_front(T&& item)
+				{
+					emplace_front(std::move(item));
+				}
+
+				// Constructs an item in place at front of Queue
+				template <typename... Args>
+				void emplace_front(Args&&... args)
+				{
+					std::unique_lock lock(muxQueue);
+					deqQueue.emplace_front(std::forward<Args>(args)...);
+					notify(lock);
 				}
 
 				// Returns true if Queue has no items
@@ -81,9 +159,233 @@ namespace ocl
 					return (t);
 				}
 
+				// Moves up to nMax items from front of Queue onto the back of
+				// container under a single lock, returns how many were moved
+				template <typename Container>
+				size_t drain(Container &container, size_t nMax = -1)
+				{
+					std::scoped_lock lock(muxQueue);
+					size_t nCount = std::min(nMax, deqQueue.size());
+					for (size_t i = 0; i < nCount; i++)
+					{
+						container.push_back(std::move(deqQueue.front()));
+						deqQueue.pop_front();
+					}
+					return (nCount);
+				}
+
+				// Swaps the whole contents of Queue with deq, leaving Queue holding
+				// whatever deq held before
+				void swap_out(std::deque<T> &deq)
+				{
+					std::scoped_lock lock(muxQueue);
+					deqQueue.swap(deq);
+				}
+
+				// Blocks until Queue has at least one item, or wake is called
+				void wait()
+				{
+					static_assert(SyncPolicy::blocking, "This queue's policy doesn't support waiting");
+					std::unique_lock lock(muxQueue);
+					nWaiters++;
+					cvBlocking.wait(lock, [this]() { return (!deqQueue.empty() || bWake); });
+					nWaiters--;
+					bWake = false;
+				}
+
+				// Blocks until Queue has at least one item or the timeout elapses,
+				// returns true if there is something to pop
+				template <typename Rep, typename Period>
+				bool wait_for(const std::chrono::duration<Rep, Period> &timeout)
+				{
+					return (wait_until(std::chrono::steady_clock::now() + timeout));
+				}
+
+				// Blocks until Queue has at least one item or the deadline passes,
+				// returns true if there is something to pop
+				template <typename Clock, typename Duration>
+				bool wait_until(const std::chrono::time_point<Clock, Duration> &deadline)
+				{
+					static_assert(SyncPolicy::blocking, "This queue's policy doesn't support waiting");
+					std::unique_lock lock(muxQueue);
+					nWaiters++;
+					cvBlocking.wait_until(lock, deadline, [this]() { return (!deqQueue.empty() || bWake); });
+					nWaiters--;
+					bWake = false;
+					return (!deqQueue.empty());
+				}
+
+				// Gets a thread blocked in a wait to return with nothing to pop. If
+				// nobody is waiting, the next wait returns straight away
+				void wake()
+				{
+					static_assert(SyncPolicy::blocking, "This queue's policy doesn't support waiting");
+					std::unique_lock lock(muxQueue);
+					bWake = true;
+					lock.unlock();
+					cvBlocking.notify_all();
+				}
+
+			private:
+				// Wakes a waiter, if there is one. When nobody is sleeping on the
+				// queue, pushing costs no more than it did before
+				void notify(std::unique_lock<mutex_type> &lock)
+				{
+					if constexpr (SyncPolicy::blocking)
+					{
+						bool bWake = nWaiters > 0;
+						lock.unlock();
+						if (bWake)
+							cvBlocking.notify_one();
+					}
+				}
+
 			protected:
-				std::mutex		muxQueue;
+				mutex_type		muxQueue;
 				std::deque<T>	deqQueue;
+				condition_type	cvBlocking;
+				size_t			nWaiters = 0;
+				bool			bWake = false;
+		};
+
+		// Single-producer/single-consumer specialisation. push_back/back belong to
+		// the producer thread, front/pop_front/drain/clear to the consumer thread.
+		// push_front/pop_back would need both ends and are not provided, and with
+		// no lock to sleep on neither are the wait functions
+		template <typename T, size_t Capacity>
+		class tsqueue<T, spsc_lock<Capacity>> : public queue_sink<T>
+		{
+			public:
+				tsqueue() : vSlots(new slot[Capacity]) {}
+				tsqueue(const tsqueue<T, spsc_lock<Capacity>>&) = delete;
+				virtual ~tsqueue() { clear(); }
+
+			public:
+				// Returns and maintains item at front of Queue - consumer only
+				const T& front()
+				{
+					return (*vSlots[nHead.load(std::memory_order_relaxed) & nMask].item());
+				}
+
+				// Returns and maintains item at back of Queue - producer only
+				const T& back()
+				{
+					return (*vSlots[(nTail.load(std::memory_order_relaxed) - 1) & nMask].item());
+				}
+
+				// Adds an item to back of Queue, yields while the ring is full
+				void push_back(const T& item) override
+				{
+					emplace_back(item);
+				}
+
+				void push_back(T&& item) override
+				{
+					emplace_back(std::move(item));
+				}
+
+				// Constructs an item in place at back of Queue, yields while the ring is full
+				template <typename... Args>
+				void emplace_back(Args&&... args)
+				{
+					// Arguments are only consumed once a slot is free, so retrying is safe
+					while (!try_emplace_back(std::forward<Args>(args)...))
+						std::this_thread::yield();
+				}
+
+				// Adds an item to back of Queue, returns false if the ring is full
+				bool try_push_back(const T& item)
+				{
+					return (try_emplace_back(item));
+				}
+
+				bool try_push_back(T&& item)
+				{
+					return (try_emplace_back(std::move(item)));
+				}
+
+				// Constructs an item in place at back of Queue, returns false if the ring is full
+				template <typename... Args>
+				bool try_emplace_back(Args&&... args)
+				{
+					size_t nPos = nTail.load(std::memory_order_relaxed);
+					if (nPos - nHeadCache == Capacity)
+					{
+						// Looks full from here, see how far the consumer has got
+						nHeadCache = nHead.load(std::memory_order_acquire);
+						if (nPos - nHeadCache == Capacity)
+							return (false);
+					}
+
+					new (&vSlots[nPos & nMask].storage) T(std::forward<Args>(args)...);
+					nTail.store(nPos + 1, std::memory_order_release);
+					return (true);
+				}
+
+				// Returns true if Queue has no items
+				bool empty()
+				{
+					return (nHead.load(std::memory_order_relaxed) == nTail.load(std::memory_order_acquire));
+				}
+
+				// Returns number of items in Queue
+				size_t count()
+				{
+					return (nTail.load(std::memory_order_acquire) - nHead.load(std::memory_order_acquire));
+				}
+
+				// Clears Queue - consumer only
+				void clear()
+				{
+					while (!empty())
+						pop_front();
+				}
+
+				// Removes and returns item from front of Queue - consumer only
+				T pop_front()
+				{
+					size_t nPos = nHead.load(std::memory_order_relaxed);
+					slot &s = vSlots[nPos & nMask];
+
+					T t = std::move(*s.item());
+					s.item()->~T();
+
+					nHead.store(nPos + 1, std::memory_order_release);
+					return (t);
+				}
+
+				// Moves up to nMax items from front of Queue onto the back of
+				// container, returns how many were moved - consumer only
+				template <typename Container>
+				size_t drain(Container &container, size_t nMax = -1)
+				{
+					size_t nCount = 0;
+					while (nCount < nMax && !empty())
+					{
+						container.push_back(pop_front());
+						nCount++;
+					}
+					return (nCount);
+				}
+
+			private:
+				struct slot
+				{
+					typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+
+					T* item() { return (std::launder(reinterpret_cast<T*>(&storage))); }
+				};
+
+				static constexpr size_t nMask = Capacity - 1;
+
+			protected:
+				// Consumer and producer ends live on separate cache lines, each
+				// side keeps a stale copy of the other's position to avoid
+				// reading the shared one on every call
+				alignas(64) std::atomic<size_t>	nHead{ 0 };
+				alignas(64) std::atomic<size_t>	nTail{ 0 };
+				size_t							nHeadCache = 0;
+				std::unique_ptr<slot[]>			vSlots;
 		};
 	}
 }
@@ -0,0 +1,152 @@
+#pragma once
+#include "net_common.hpp"
+#include "net_message.hpp"
+
+namespace olc
+{
+	namespace net
+	{
+		// How a message_header goes on the wire
+		enum class wire_format : uint8_t
+		{
+			// Little-endian id (the width of T's underlying type) then a
+			// little-endian uint32_t body length, no padding
+			fixed,
+
+			// One version/flags byte, then the id and the body length as LEB128
+			// varints. A small message costs 3 bytes of header
+			compact,
+		};
+
+		// Per message type wire settings. Specialise this for your T to change
+		// them, e.g. to talk to peers that use the fixed layout
+		template <typename T>
+		struct header_traits
+		{
+			static constexpr wire_format format = wire_format::compact;
+
+			// Frames claiming a bigger body than this are rejected, so a corrupt
+			// or hostile header can't make us allocate gigabytes
+			static constexpr uint32_t nMaxBodySize = 16 * 1024 * 1024;
+		};
+
+		// Encodes and decodes message headers in the format header_traits picks.
+		// Decoding happens in two steps so it fits exact-size socket reads: read
+		// nPrefixSize bytes, ask remaining() how many more make up the header,
+		// read those, then decode() the lot
+		template <typename T>
+		struct wire_header
+		{
+			using traits = header_traits<T>;
+			using id_type = typename std::conditional_t<std::is_enum<T>::value, std::underlying_type<T>, std::common_type<T>>::type;
+			using uid_type = std::make_unsigned_t<id_type>;
+
+			// Compact version/flags byte: top 3 bits version, one reserved flag
+			// bit, and the low 4 bits count the varint bytes that follow
+			static constexpr uint8_t nVersion = 2;
+			static constexpr uint8_t nFlagReserved = 0x10;
+			static constexpr uint8_t nLengthMask = 0x0F;
+
+			static constexpr size_t nFixedSize = sizeof(id_type) + sizeof(uint32_t);
+			static constexpr size_t nMaxSize = std::max<size_t>(nFixedSize, 1 + 10 + 5);
+			static constexpr size_t nPrefixSize = traits::format == wire_format::fixed ? nFixedSize : 1;
+
+			// Writes the header for a body of nBodySize bytes into p, which must
+			// have room for nMaxSize bytes. Returns the number of bytes written
+			static size_t encode(const message_header<T> &header, uint32_t nBodySize, uint8_t *p)
+			{
+				uint64_t nId = uint64_t(uid_type(header.id));
+
+				if constexpr (traits::format == wire_format::fixed)
+				{
+					for (size_t i = 0; i < sizeof(id_type); i++)
+						p[i] = uint8_t(nId >> (8 * i));
+					for (size_t i = 0; i < sizeof(uint32_t); i++)
+						p[sizeof(id_type) + i] = uint8_t(nBodySize >> (8 * i));
+					return (nFixedSize);
+				}
+				else
+				{
+					size_t n = 1;
+					n += put_varint(nId, p + n);
+					n += put_varint(nBodySize, p + n);
+					p[0] = uint8_t((nVersion << 5) | (n - 1));
+					return (n);
+				}
+			}
+
+			// Given the first nPrefixSize bytes, works out how many more belong
+			// to the header. Returns false if they aren't a header we understand
+			static bool remaining(const uint8_t *p, size_t &nMore)
+			{
+				if constexpr (traits::format == wire_format::fixed)
+				{
+					nMore = 0;
+					return (true);
+				}
+				else
+				{
+					nMore = p[0] & nLengthMask;
+					return ((p[0] >> 5) == nVersion && nMore >= 2);
+				}
+			}
+
+			// Decodes a complete header of nSize bytes. header.size becomes the
+			// body length. Returns false if the header is malformed
+			static bool decode(const uint8_t *p, size_t nSize, message_header<T> &header)
+			{
+				uint64_t nId = 0, nBodySize = 0;
+
+				if constexpr (traits::format == wire_format::fixed)
+				{
+					if (nSize != nFixedSize)
+						return (false);
+					for (size_t i = 0; i < sizeof(id_type); i++)
+						nId |= uint64_t(p[i]) << (8 * i);
+					for (size_t i = 0; i < sizeof(uint32_t); i++)
+						nBodySize |= uint64_t(p[sizeof(id_type) + i]) << (8 * i);
+				}
+				else
+				{
+					const uint8_t *pEnd = p + nSize;
+					p++;
+					if (!get_varint(p, pEnd, nId) || !get_varint(p, pEnd, nBodySize) || p != pEnd)
+						return (false);
+				}
+
+				if (nId > std::numeric_limits<uid_type>::max() || nBodySize > traits::nMaxBodySize)
+					return (false);
+
+				header.id = T(id_type(uid_type(nId)));
+				header.size = uint32_t(nBodySize);
+				return (true);
+			}
+
+		private:
+			static size_t put_varint(uint64_t nValue, uint8_t *p)
+			{
+				size_t n = 0;
+				while (nValue >= 0x80)
+				{
+					p[n++] = uint8_t(nValue) | 0x80;
+					nValue >>= 7;
+				}
+				p[n++] = uint8_t(nValue);
+				return (n);
+			}
+
+			static bool get_varint(const uint8_t *&p, const uint8_t *pEnd, uint64_t &nValue)
+			{
+				nValue = 0;
+				for (unsigned nShift = 0; p < pEnd && nShift < 64; nShift += 7)
+				{
+					uint8_t b = *p++;
+					nValue |= uint64_t(b & 0x7F) << nShift;
+					if (!(b & 0x80))
+						return (true);
+				}
+				return (false);
+			}
+		};
+	}
+}
@@ -2,5 +2,6 @@
 
 #include "net_common.hpp"
 #include "net_message.hpp"
+#include "net_reader.hpp"
 
 #include "net_client.hpp"
@@ -40,7 +40,7 @@ int main()
 
 	while (1)
 	{
-		server.Update();
+		server.Update(-1, true);
 	}
 
 	return (0);
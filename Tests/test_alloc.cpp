@@ -0,0 +1,159 @@
+// Counts message bodies while messages make the real trip over loopback: a
+// client sends, the server's connection reads the frame and queues it,
+// Update hands it to OnMessage, which echoes it back with MessageClient, and
+// the client reads the echo. Every step moves the body along, so each round
+// trip should take exactly three bodies from buffer_pool - the one the
+// client built and the two the connections read into - and any copy on the
+// way shows up as a fourth. Bodies small enough to live in the message take
+// none at all. Global operator new calls are shown alongside; those are
+// asio's operation storage and buffer sequences, not bodies
+
+#include <olc_net.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+
+// The replacements below pair malloc with free, which GCC can't see
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+static std::atomic<bool> g_bCounting{ false };
+static std::atomic<uint64_t> g_nAllocations{ 0 };
+
+void *operator new(size_t nBytes)
+{
+	if (g_bCounting.load(std::memory_order_relaxed))
+		g_nAllocations.fetch_add(1, std::memory_order_relaxed);
+	if (void *p = std::malloc(nBytes ? nBytes : 1))
+		return (p);
+	throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept
+{
+	std::free(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	std::free(p);
+}
+
+enum class MsgTypes : uint32_t
+{
+	Data
+};
+
+using message = olc::net::message<MsgTypes>;
+
+class EchoServer : public olc::net::server_interface<MsgTypes>
+{
+	public:
+		EchoServer(uint16_t nPort) : olc::net::server_interface<MsgTypes>(nPort)
+		{
+
+		}
+
+	protected:
+		bool OnClientConnect(std::shared_ptr<olc::net::connection<MsgTypes>>) override
+		{
+			return (true);
+		}
+
+		void OnMessage(std::shared_ptr<olc::net::connection<MsgTypes>> client, message &msg) override
+		{
+			MessageClient(std::move(client), std::move(msg));
+		}
+};
+
+class Client : public olc::net::client_interface<MsgTypes>
+{
+	public:
+		void Send(message &&msg)
+		{
+			m_connection->Send(std::move(msg));
+		}
+};
+
+static uint64_t BodiesTaken()
+{
+	olc::net::buffer_pool_stats stats = olc::net::buffer_pool::GetStats();
+	return (stats.nHits + stats.nMisses);
+}
+
+// One message there and back, checking it comes back intact
+static bool RoundTrip(EchoServer &server, Client &client, size_t nWords)
+{
+	message msgOut;
+	msgOut.header.id = MsgTypes::Data;
+	msgOut.body.reserve(nWords * sizeof(uint32_t));
+	for (uint32_t i = 0; i < nWords; i++)
+		msgOut << i;
+	client.Send(std::move(msgOut));
+
+	server.Update(-1, true);
+	client.Incoming().wait();
+
+	message msgIn = client.Incoming().pop_front().msg;
+	if (msgIn.body.size() != nWords * sizeof(uint32_t))
+		return (false);
+	for (uint32_t i = uint32_t(nWords); i-- > 0;)
+	{
+		uint32_t n = 0;
+		msgIn >> n;
+		if (n != i)
+			return (false);
+	}
+	return (true);
+}
+
+static bool Check(const char *sName, uint16_t nPort, size_t nWords, uint64_t nBodiesPerTrip)
+{
+	EchoServer server(nPort);
+	if (!server.Start())
+		return (false);
+
+	Client client;
+	client.Connect("127.0.0.1", nPort);
+	while (server.GetAcceptStats().nAccepted == 0)
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+	// Warm the pool's free lists, the queues and asio's handler memory
+	bool bOk = true;
+	for (int i = 0; i < 200; i++)
+		bOk &= RoundTrip(server, client, nWords);
+
+	const int nTrips = 2000;
+	uint64_t nBodiesBefore = BodiesTaken();
+	g_nAllocations = 0;
+	g_bCounting = true;
+	for (int i = 0; i < nTrips && bOk; i++)
+		bOk &= RoundTrip(server, client, nWords);
+	g_bCounting = false;
+	uint64_t nBodies = BodiesTaken() - nBodiesBefore;
+	uint64_t nAllocations = g_nAllocations.load();
+
+	client.Disconnect();
+	server.Stop();
+
+	std::printf("%-20s %6zu bytes  %6.3f bodies per round trip (want %llu)  %6.3f heap allocations per message  %s\n",
+		sName, nWords * sizeof(uint32_t), double(nBodies) / nTrips, (unsigned long long)nBodiesPerTrip,
+		double(nAllocations) / (2 * nTrips), bOk ? "" : "(corrupt)");
+	return (bOk && nBodies == nBodiesPerTrip * nTrips);
+}
+
+int main()
+{
+	olc::net::logger::Get().SetLevel(olc::net::log_level::warn);
+
+	bool bOk = true;
+	bOk &= Check("inline body", 60710, 8, 0);
+	bOk &= Check("inline body, full", 60711, 16, 0);
+	bOk &= Check("pooled body", 60712, 256, 3);
+	bOk &= Check("pooled body, large", 60713, 4 * 1024, 3);
+
+	std::printf("%s\n", bOk ? "PASS" : "FAIL");
+	return (bOk ? 0 : 1);
+}